@@ -2,20 +2,47 @@
 #include <SDL2/SDL.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <limits.h>
 #include <time.h>
 #include <stdbool.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
-#define WINDOW_W 1200
-#define WINDOW_H 675
+// The simulation has to give the same results on every build, or replays and
+// hash checkpoints stop matching. Contracting a * b + c into an FMA rounds
+// once instead of twice, so it is turned off for the whole file whatever the
+// target or -march.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#elif defined(_MSC_VER)
+#pragma fp_contract(off)
+#endif
 
+// The world, which wraps at its edges, and the logical canvas everything is
+// drawn on. The window can be any size; render() scales the frame to fit.
+#define WORLD_W 1200
+#define WORLD_H 675
+
+// Default capacities; override with --config FILE or --max-clouds N etc.
 #define MAX_CLOUDS    120
 #define MAX_PARTICLES 700
 #define MAX_CREATURES 38
 #define MAX_NEBULAE   12
-#define NUM_STARS     600
-#define NUM_DEBRIS    300
+#define STARS_PER_SCREEN  8   // on average, per WORLD_W of layer
+#define DEBRIS_PER_SCREEN 3
 #define NUM_PLANETS   6
+#define MAX_CAPACITY  10000000
 
 #define SHIP_ROT_SPEED    0.10f
 #define SHIP_THRUST       0.12f
@@ -41,6 +68,10 @@
 #define CLOUDS_PER_WAVE_BASE 45
 #define WAVE_CREATURE_BONUS 4
 
+// Simulation runs at a fixed tick rate; rendering interpolates between ticks
+#define SIM_HZ 60
+#define MAX_TICKS_PER_FRAME 5
+
 typedef struct {
     float x, y, vx, vy, angle;
     float fuel, heat;
@@ -51,25 +82,70 @@ typedef struct {
     bool combo_boost_active;
     int combo_boost_timer;
     float overheat_damage_accumulator;
+    float prev_x, prev_y, prev_angle;
 } Ship;
 
+// Entity storage. Clouds and creatures are packed into dense component
+// arrays: the motion state every pass reads, the previous tick's pose for
+// interpolation, and cold per-kind data that only spawning and drawing touch.
+// Removing an entity moves the last one into its place, so dense indices
+// change; a Handle does not. It names a slot whose generation is bumped when
+// the entity goes, and the slot table follows the entity around.
+typedef struct { Uint32 slot, generation; } Handle;
+
+typedef struct {
+    int* slot_of;         // per dense index
+    int* dense_of;        // per slot, -1 when free
+    Uint32* generation;   // per slot
+    int* free_slots;      // a stack
+    int free_cnt;
+} EntityIds;
+
+// Per-tick phase advance of the cloud pulse and the creature hunt cycle. The
+// phases only feed rendering, so they are stored at frame 0 and derived.
+#define CLOUD_PULSE_RATE 0.08f
+#define CREATURE_HUNT_RATE 0.04f
+
+typedef struct { float x, y, vx, vy; } Motion;
+typedef struct { float x, y, angle; } Pose;
+
 typedef struct {
-    float x, y, vx, vy;
-    float size, density, phase;
+    float size, density;
+    float phase;          // pulse phase at frame 0
     float pull_strength;
     int value;
-    int active;
     Uint32 color;
-} GasCloud;
+} CloudInfo;
 
 typedef struct {
-    float x, y, vx, vy, angle, wiggle;
-    float size, hunt_phase, patrol_phase;
-    float target_x, target_y;
+    int count, capacity;
+    Motion* motion;
+    SDL_FPoint* prev;
+    CloudInfo* info;
+    EntityIds ids;
+} CloudStore;
+
+typedef struct {
+    float angle, wiggle;
     int type;
-    int active;
+} CreatureSteer;
+
+typedef struct {
+    float size;
+    float hunt_phase;     // at frame 0
+    float patrol_phase;
+    float target_x, target_y;
     Uint32 color;
-} NebulaCreature;
+} CreatureInfo;
+
+typedef struct {
+    int count, capacity;
+    Motion* motion;
+    CreatureSteer* steer;
+    Pose* prev;
+    CreatureInfo* info;
+    EntityIds ids;
+} CreatureStore;
 
 typedef struct {
     float x, y;
@@ -79,15 +155,33 @@ typedef struct {
     bool active;
 } Nebula;
 
+// Every particle remembers which effect emitted it, so the budget can
+// prioritise and report per effect
+enum { EMIT_HARVEST, EMIT_DANGER, EMIT_OVERHEAT, EMIT_THRUST, EMIT_TRAIL, EMIT_TRACTOR, EMITTER_COUNT };
+
+// Particles are stored as structure-of-arrays so the integration kernel can
+// run over each field with SIMD. grav is the per-particle gravity term,
+// precomputed from the color's alpha at spawn time.
 typedef struct {
-    float x, y, vx, vy;
-    float life;
-    Uint32 color;
-    int active;
-} Particle;
+    int count, capacity;     // capacity bounds the live particles
+    int slots;               // array room, which also holds a tick's evictions
+    int live[EMITTER_COUNT];
+    float* x;
+    float* y;
+    float* vx;
+    float* vy;
+    float* life;
+    float* grav;
+    float* prev_x;
+    float* prev_y;
+    Uint32* color;
+    Uint8* emitter;
+} ParticlePool;
 
+// Stars and debris are generated per layer tile on demand; base_x is relative
+// to the tile range they were generated for
 typedef struct { float base_x, base_y; int brightness, phase, size; } Star;
-typedef struct { float base_x, base_y; float vx; int size; } Debris;
+typedef struct { float base_x, base_y; float vx, phase; int size; } Debris;
 typedef struct { float base_x, base_y; float radius; Uint32 color; float spin; } Planet;
 typedef struct {
     float base_x, base_y;
@@ -95,957 +189,5659 @@ typedef struct {
     float pulse_phase;
 } Sun;
 
-Ship ship;
-GasCloud clouds[MAX_CLOUDS];
-NebulaCreature creatures[MAX_CREATURES];
-Nebula nebulas[MAX_NEBULAE];
-Particle particles[MAX_PARTICLES];
-Star stars[NUM_STARS];
-Debris debris[NUM_DEBRIS];
-Planet planets[NUM_PLANETS];
-Sun sun;
-
-int cloud_cnt = 0;
-int creature_cnt = 0;
-int particle_cnt = 0;
-int nebula_cnt = 0;
-int frame = 0;
-float scrollX = 0.0f;
-float danger_level = 0.0f;
-int combo_timer = 0;
-
-int wave = 1;
-int clouds_collected_this_wave = 0;
-int clouds_needed_for_next_wave = CLOUDS_PER_WAVE_BASE;
-int wave_flash_timer = 0;
-int current_wave_display_timer = 0;
+// Entity capacities, fixed at startup
+typedef struct {
+    int max_clouds;
+    int max_creatures;
+    int max_particles;
+    int stars_per_screen;    // densities; the field itself takes no memory
+    int debris_per_screen;
+} Capacities;
+
+Capacities caps = {MAX_CLOUDS, MAX_CREATURES, MAX_PARTICLES, STARS_PER_SCREEN, DEBRIS_PER_SCREEN};
 
 SDL_Window* window = NULL;
 SDL_Renderer* renderer = NULL;
 
-void wrap(float* x, float* y) {
-    *x = fmodf(*x + WINDOW_W * 10, WINDOW_W);
-    *y = fmodf(*y + WINDOW_H * 10, WINDOW_H);
+// Interpolation state for the frame being rendered: render_alpha is how far we
+// are between the previous tick and the current one.
+float render_alpha = 1.0f;
+float render_frame = 0.0f;
+float render_scroll = 0.0f;
+
+// Everything the renderer reads, copied out of the simulation after each
+// tick. Drawing code only ever looks at `view`, so a frame can be drawn while
+// the next tick is being simulated on another thread.
+typedef struct {
+    Ship ship;
+    int frame;
+    float scrollX, prev_scrollX;
+    int wave;
+    int current_wave_display_timer;
+    Sun sun;
+    Nebula nebulas[MAX_NEBULAE];
+    Planet planets[NUM_PLANETS];
+    CloudStore clouds;        // only the components the renderer reads
+    CreatureStore creatures;
+    Uint32 starfield_seed;
+    ParticlePool particles;   // only the fields the renderer reads
+} Snapshot;
+
+Snapshot* view;
+
+// Render-side scratch for the stars and debris in view, and batched trig
+// over them
+Star* field_stars;
+Debris* field_debris;
+float* trig_x;
+float* trig_arg;
+float* trig_sin;
+float* trig_cos;
+
+typedef struct {
+    Uint64 frames;
+    Uint64 ticks;
+    Uint64 ticks_per_frame[MAX_TICKS_PER_FRAME + 1];
+    Uint64 missed_deadlines;   // frames where sim time had to be dropped
+    Uint64 dropped_ticks;
+    Uint64 sleeps;
+} LoopStats;
+
+LoopStats loop_stats;
+
+// Frame profiler. PROF_BEGIN/PROF_END pairs time the phases of update() and
+// render() into a lock-free ring buffer per thread track, together with the
+// SDL draw calls and color-state changes made in between. F8 toggles the
+// overlay, F9 writes profile.csv and profile.json (for chrome://tracing).
+// Building with -DHARVESTER_NO_PROFILER compiles all of it out.
+enum {
+    PROF_TICK, PROF_SHIP, PROF_CLOUDS, PROF_CREATURES, PROF_PARTICLES, PROF_SNAPSHOT,
+    PROF_FRAME, PROF_BACKGROUND, PROF_ENTITIES, PROF_PARTICLE_DRAW, PROF_HUD, PROF_OVERLAY, PROF_PRESENT,
+    PROF_PHASE_COUNT
+};
+
+enum { PROF_TRACK_SIM, PROF_TRACK_RENDER, PROF_TRACK_COUNT };
+
+typedef struct {
+    const char* name;
+    int track;
+    Uint8 rgb[3];   // overlay color
+} ProfPhase;
+
+// The root phase of each track comes first and spans the others
+const ProfPhase prof_phases[PROF_PHASE_COUNT] = {
+    {"tick", PROF_TRACK_SIM, {200, 200, 200}},
+    {"ship", PROF_TRACK_SIM, {180, 255, 180}},
+    {"clouds", PROF_TRACK_SIM, {170, 238, 255}},
+    {"creatures", PROF_TRACK_SIM, {255, 90, 90}},
+    {"particles", PROF_TRACK_SIM, {255, 220, 120}},
+    {"snapshot", PROF_TRACK_SIM, {200, 140, 255}},
+    {"frame", PROF_TRACK_RENDER, {200, 200, 200}},
+    {"background", PROF_TRACK_RENDER, {90, 110, 255}},
+    {"entities", PROF_TRACK_RENDER, {170, 238, 255}},
+    {"particle draw", PROF_TRACK_RENDER, {255, 220, 120}},
+    {"hud", PROF_TRACK_RENDER, {180, 255, 180}},
+    {"profiler", PROF_TRACK_RENDER, {255, 255, 255}},
+    {"present", PROF_TRACK_RENDER, {255, 90, 90}},
+};
+
+const char* prof_track_names[PROF_TRACK_COUNT] = {"sim", "render"};
+
+#ifndef HARVESTER_NO_PROFILER
+#define PROF_RING 16384   // events per track, a power of two
+
+typedef struct {
+    Uint64 start, end;   // performance counter
+    Uint32 draw_calls, color_changes;
+    int phase;
+} ProfEvent;
+
+// Only the track's own thread writes; head counts the events published so far
+typedef struct {
+    ProfEvent events[PROF_RING];
+    SDL_atomic_t head;
+} ProfTrack;
+
+typedef struct {
+    Uint64 start;
+    Uint32 draw_calls, color_changes;
+} ProfOpen;
+
+ProfTrack prof_tracks[PROF_TRACK_COUNT];
+ProfOpen prof_open[PROF_PHASE_COUNT];
+Uint32 prof_draw_calls = 0;      // render thread only
+Uint32 prof_color_changes = 0;
+Uint64 prof_epoch = 0;
+bool show_profiler = false;
+bool prof_paused = false;        // while batched worlds tick on several threads
+
+void prof_begin(int phase) {
+    if (prof_paused) return;
+    ProfOpen* o = &prof_open[phase];
+    o->start = SDL_GetPerformanceCounter();
+    if (prof_phases[phase].track == PROF_TRACK_RENDER) {
+        o->draw_calls = prof_draw_calls;
+        o->color_changes = prof_color_changes;
+    }
 }
 
-float distance(float x1, float y1, float x2, float y2) {
-    float dx = x1 - x2;
-    float dy = y1 - y2;
-    if (fabsf(dx) > WINDOW_W / 2) dx -= (dx > 0 ? WINDOW_W : -WINDOW_W);
-    if (fabsf(dy) > WINDOW_H / 2) dy -= (dy > 0 ? WINDOW_H : -WINDOW_H);
-    return hypotf(dx, dy);
+void prof_end(int phase) {
+    if (prof_paused) return;
+    const ProfOpen* o = &prof_open[phase];
+    ProfTrack* t = &prof_tracks[prof_phases[phase].track];
+    Uint32 head = (Uint32)SDL_AtomicGet(&t->head);
+    ProfEvent* e = &t->events[head & (PROF_RING - 1)];
+    *e = (ProfEvent){o->start, SDL_GetPerformanceCounter(), 0, 0, phase};
+    if (prof_phases[phase].track == PROF_TRACK_RENDER) {
+        e->draw_calls = prof_draw_calls - o->draw_calls;
+        e->color_changes = prof_color_changes - o->color_changes;
+    }
+    SDL_AtomicSet(&t->head, (int)(head + 1));
 }
 
-void spawn_particle(float x, float y, float vx, float vy, Uint32 color, float life) {
-    if (particle_cnt >= MAX_PARTICLES) return;
-    particles[particle_cnt++] = (Particle){x, y, vx, vy, life, color, 1};
+#define PROF_BEGIN(phase) prof_begin(phase)
+#define PROF_END(phase) prof_end(phase)
+#define PROF_DRAW_CALL() (prof_draw_calls++)
+#define PROF_COLOR_CHANGE() (prof_color_changes++)
+#define PROF_PAUSE(on) (prof_paused = (on))
+#else
+#define PROF_BEGIN(phase) ((void)0)
+#define PROF_END(phase) ((void)0)
+#define PROF_DRAW_CALL() ((void)0)
+#define PROF_COLOR_CHANGE() ((void)0)
+#define PROF_PAUSE(on) ((void)0)
+#endif
+
+// Fast math: polynomial approximations of the libm functions in the hot
+// loops, as scalar functions and SSE2 array kernels. The kernels do exactly
+// the same float operations as the scalar versions, and unlike libm the
+// results don't vary between C libraries. Both only stay bit-identical across
+// builds because FP contraction is off (see the top of the file);
+// --headless 5000 --seed 7 --expect-hash a3ec907681e4aa2d checks a build.
+// Maximum errors, checked by --bench-math:
+//   fast_sincos  |x| <= 1e3   abs error <= 1.5e-7  (SINCOS_MAX_ERR)
+//                |x| <= 1e5   abs error <= 1.5e-6  (SINCOS_MAX_ERR_WIDE)
+//   fast_atan2   any x, y     abs error <= 2.5e-6 rad  (ATAN2_MAX_ERR)
+//   fast_rsqrt   x > 0        rel error <= 5e-7  (RSQRT_MAX_ERR)
+// Past |x| = 1e5 the pi/2 reduction slowly loses accuracy rather than failing.
+// fast_rsqrt refines the hardware estimate, which differs between CPU
+// vendors, so it is only used for drawing, never by the simulation.
+#define SINCOS_MAX_ERR      1.5e-7f
+#define SINCOS_MAX_ERR_WIDE 1.5e-6f
+#define ATAN2_MAX_ERR       2.5e-6f
+#define RSQRT_MAX_ERR       5e-7f
+
+// pi/2 split into three parts so q * FM_PI_2_A is exact for |q| < 2^16
+#define FM_2_PI   0.63661977236758134f
+#define FM_PI_2_A 1.5703125f
+#define FM_PI_2_B 4.837512969970703125e-4f
+#define FM_PI_2_C 7.54978995489188216e-8f
+
+static inline void fast_sincos(float x, float* s, float* c) {
+    float t = x * FM_2_PI;
+    int q = (int)(t + (t >= 0 ? 0.5f : -0.5f));
+    float fq = (float)q;
+    float r = ((x - fq * FM_PI_2_A) - fq * FM_PI_2_B) - fq * FM_PI_2_C;
+    float z = r * r;
+    float sp = r + r * z * (-1.6666654611e-1f + z * (8.3321608736e-3f + z * -1.9515295891e-4f));
+    float cp = 1.0f - 0.5f * z + z * z * (4.166664568298827e-2f + z * (-1.388731625493765e-3f + z * 2.443315711809948e-5f));
+    float sv = (q & 1) ? cp : sp;
+    float cv = (q & 1) ? sp : cp;
+    *s = (q & 2) ? -sv : sv;
+    *c = ((q + 1) & 2) ? -cv : cv;
 }
 
-void harvest_effect(float x, float y, int intensity) {
-    for (int i = 0; i < 30 + intensity * 15; i++) {
-        float ang = (float)i / (30 + intensity * 15) * 2 * M_PI;
-        float speed = 3.5f + (rand() % 90) / 30.0f;
-        Uint32 c = 0xAAEEFFAA | ((rand() % 120 + 135) << 24);
-        spawn_particle(x, y, cosf(ang) * speed, sinf(ang) * speed * 0.7f, c, 60 + rand() % 50);
-    }
+static inline float fast_sin(float x) {
+    float s, c;
+    fast_sincos(x, &s, &c);
+    return s;
 }
 
-void tractor_beam_effect(float x1, float y1, float x2, float y2) {
-    for (int i = 0; i < 18; i++) {
-        float t = (float)i / 18.0f + (rand() % 20)/1000.0f;
-        float px = x1 + (x2 - x1) * t;
-        float py = y1 + (y2 - y1) * t;
-        float jitter_x = (rand() % 40 - 20) * 0.15f;
-        float jitter_y = (rand() % 40 - 20) * 0.15f;
-        Uint32 c = 0xCCEEFFFF | ((200 + (int)(sinf(frame * 0.5f + i) * 55)) << 24);
-        spawn_particle(px + jitter_x, py + jitter_y, (rand() % 40 - 20) * 0.2f, (rand() % 40 - 20) * 0.2f, c, 40 + rand() % 20);
-    }
+static inline float fast_cos(float x) {
+    float s, c;
+    fast_sincos(x, &s, &c);
+    return c;
 }
 
-void danger_trail(float x, float y) {
-    for (int i = 0; i < 8; i++) {
-        float ang = (rand() % 360) * M_PI / 180.0f;
-        float speed = 5.0f + (rand() % 50) / 10.0f;
-        Uint32 c = 0xFF4444FF | ((rand() % 100 + 140) << 24);
-        spawn_particle(x, y, cosf(ang) * speed, sinf(ang) * speed, c, 30 + rand() % 25);
-    }
+static inline float fast_atan2(float y, float x) {
+    float ax = fabsf(x), ay = fabsf(y);
+    float hi = ax > ay ? ax : ay, lo = ax > ay ? ay : ax;
+    float a = hi > 0 ? lo / hi : 0.0f;
+    float z = a * a;
+    float r = a * (0.99997726f + z * (-0.33262347f + z * (0.19354346f + z * (-0.11643287f + z * (0.05265332f + z * -0.01172120f)))));
+    if (ay > ax) r = 1.57079637f - r;
+    if (x < 0) r = 3.14159274f - r;
+    return y < 0 ? -r : r;
 }
 
-void critical_overheat_effect() {
-    float rear = ship.angle + M_PI;
-    for (int i = 0; i < 8; i++) {
-        float ang = rear + (rand() % 100 - 50) * 0.018f;
-        float spd = 3.5f + (rand() % 60)/10.0f;
-        Uint32 c = 0xAA444444 | ((90 + rand() % 80) << 24);
-        spawn_particle(ship.x + cosf(rear)*20, ship.y + sinf(rear)*20,
-                       cosf(ang)*spd + ship.vx*0.3f, sinf(ang)*spd + ship.vy*0.3f,
-                       c, 60 + rand() % 50);
-    }
-    if (frame % 4 == 0) {
-        for (int i = 0; i < 5; i++) {
-            float ang = rand() * 2 * M_PI / RAND_MAX;
-            float spd = 4.5f + (rand() % 60)/10.0f;
-            Uint32 c = 0xFFFF8800 | ((180 + rand() % 75) << 24);
-            spawn_particle(ship.x, ship.y,
-                           cosf(ang)*spd, sinf(ang)*spd,
-                           c, 30 + rand() % 25);
-        }
-    }
+static inline float fast_rsqrt(float x) {
+#if defined(__SSE2__) || defined(_M_X64)
+    float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+    return y * (1.5f - 0.5f * x * y * y);
+#else
+    return 1.0f / sqrtf(x);
+#endif
 }
 
-void thrust_flame() {
-    float rear = ship.angle + M_PI;
-    float px = ship.x + cosf(rear) * 22;
-    float py = ship.y + sinf(rear) * 22;
-    for (int i = 0; i < 14; i++) {
-        float ang = rear + (rand() % 120 - 60) * 0.015f;
-        float spd = 7.0f + (rand() % 70) / 10.0f;
-        Uint32 c = (rand() % 3 == 0) ? 0xFFAA88FF : 0xEEFFCCFF;
-        spawn_particle(px, py, cosf(ang) * spd + ship.vx * 0.25f, sinf(ang) * spd + ship.vy * 0.25f, c, 30 + rand() % 25);
-    }
+// Euclidean length without hypotf's overflow handling, which the world's
+// coordinates never need
+static inline float fast_hypot(float x, float y) {
+    return sqrtf(x * x + y * y);
 }
 
-void trail_emit() {
-    float speed = hypotf(ship.vx, ship.vy);
-    if (speed < 3.5f || frame % 3 != 0) return;
-    float rear = atan2f(ship.vy, ship.vx) + M_PI;
-    float px = ship.x + cosf(rear) * 20;
-    float py = ship.y + sinf(rear) * 20;
-    for (int i = 0; i < 5; i++) {
-        float ang = rear + (rand() % 100 - 50) * 0.012f;
-        spawn_particle(px, py, cosf(ang) * (2.0f + speed * 0.3f), sinf(ang) * (2.0f + speed * 0.3f), 0x66DDFFFF, 40 + rand() % 35);
+// Wraps v into [0, period); inv_period must be 1 / period
+static inline float fast_wrap(float v, float period, float inv_period) {
+    float t = v * inv_period;
+    int k = (int)t;
+    if ((float)k > t) k--;
+    float r = v - (float)k * period;
+    if (r >= period) r -= period;
+    else if (r < 0) r += period;
+    return r;
+}
+
+void fast_sincos_array(const float* x, float* s, float* c, int n) {
+    int i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128 two_pi = _mm_set1_ps(FM_2_PI), half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128i one_i = _mm_set1_epi32(1), two_i = _mm_set1_epi32(2);
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(x + i);
+        __m128 t = _mm_mul_ps(v, two_pi);
+        __m128 rh = _mm_or_ps(half, _mm_and_ps(t, sign));
+        __m128i q = _mm_cvttps_epi32(_mm_add_ps(t, rh));
+        __m128 fq = _mm_cvtepi32_ps(q);
+        __m128 r = _mm_sub_ps(v, _mm_mul_ps(fq, _mm_set1_ps(FM_PI_2_A)));
+        r = _mm_sub_ps(r, _mm_mul_ps(fq, _mm_set1_ps(FM_PI_2_B)));
+        r = _mm_sub_ps(r, _mm_mul_ps(fq, _mm_set1_ps(FM_PI_2_C)));
+        __m128 z = _mm_mul_ps(r, r);
+        __m128 sp = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(-1.9515295891e-4f)), _mm_set1_ps(8.3321608736e-3f));
+        sp = _mm_add_ps(_mm_mul_ps(z, sp), _mm_set1_ps(-1.6666654611e-1f));
+        sp = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, z), sp));
+        __m128 cp = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(2.443315711809948e-5f)), _mm_set1_ps(-1.388731625493765e-3f));
+        cp = _mm_add_ps(_mm_mul_ps(z, cp), _mm_set1_ps(4.166664568298827e-2f));
+        cp = _mm_add_ps(_mm_sub_ps(one, _mm_mul_ps(half, z)), _mm_mul_ps(_mm_mul_ps(z, z), cp));
+        __m128 odd = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one_i), one_i));
+        __m128 sv = _mm_or_ps(_mm_and_ps(odd, cp), _mm_andnot_ps(odd, sp));
+        __m128 cv = _mm_or_ps(_mm_and_ps(odd, sp), _mm_andnot_ps(odd, cp));
+        __m128 sneg = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two_i), 30));
+        __m128 cneg = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one_i), two_i), 30));
+        _mm_storeu_ps(s + i, _mm_xor_ps(sv, sneg));
+        _mm_storeu_ps(c + i, _mm_xor_ps(cv, cneg));
     }
+#endif
+    for (; i < n; i++) fast_sincos(x[i], &s[i], &c[i]);
 }
 
-void thick_line(int x1, int y1, int x2, int y2, int thickness) {
-    if (thickness <= 1) {
-        SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
-        return;
+void fast_atan2_array(const float* y, const float* x, float* out, int n) {
+    int i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF)), zero = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        __m128 vy = _mm_loadu_ps(y + i), vx = _mm_loadu_ps(x + i);
+        __m128 ax = _mm_and_ps(vx, abs_mask), ay = _mm_and_ps(vy, abs_mask);
+        __m128 hi = _mm_max_ps(ax, ay), lo = _mm_min_ps(ax, ay);
+        __m128 a = _mm_and_ps(_mm_div_ps(lo, hi), _mm_cmpgt_ps(hi, zero));
+        __m128 z = _mm_mul_ps(a, a);
+        __m128 p = _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(-0.01172120f)), _mm_set1_ps(0.05265332f));
+        p = _mm_add_ps(_mm_mul_ps(z, p), _mm_set1_ps(-0.11643287f));
+        p = _mm_add_ps(_mm_mul_ps(z, p), _mm_set1_ps(0.19354346f));
+        p = _mm_add_ps(_mm_mul_ps(z, p), _mm_set1_ps(-0.33262347f));
+        p = _mm_add_ps(_mm_mul_ps(z, p), _mm_set1_ps(0.99997726f));
+        __m128 r = _mm_mul_ps(a, p);
+        __m128 m = _mm_cmpgt_ps(ay, ax);
+        r = _mm_or_ps(_mm_and_ps(m, _mm_sub_ps(_mm_set1_ps(1.57079637f), r)), _mm_andnot_ps(m, r));
+        m = _mm_cmplt_ps(vx, zero);
+        r = _mm_or_ps(_mm_and_ps(m, _mm_sub_ps(_mm_set1_ps(3.14159274f), r)), _mm_andnot_ps(m, r));
+        r = _mm_xor_ps(r, _mm_and_ps(_mm_cmplt_ps(vy, zero), _mm_set1_ps(-0.0f)));
+        _mm_storeu_ps(out + i, r);
     }
-    int dx = x2 - x1, dy = y2 - y1;
-    float len = hypotf(dx, dy);
-    if (len < 1.0f) return;
-    float nx = -dy / len, ny = dx / len;
-    for (int t = -thickness/2; t <= thickness/2; t++) {
-        int ox = (int)(nx * t), oy = (int)(ny * t);
-        SDL_RenderDrawLine(renderer, x1 + ox, y1 + oy, x2 + ox, y2 + oy);
+#endif
+    for (; i < n; i++) out[i] = fast_atan2(y[i], x[i]);
+}
+
+void fast_rsqrt_array(const float* x, float* out, int n) {
+    int i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128 half = _mm_set1_ps(0.5f), three_halves = _mm_set1_ps(1.5f);
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(x + i);
+        __m128 r = _mm_rsqrt_ps(v);
+        __m128 nr = _mm_sub_ps(three_halves, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(half, v), r), r));
+        _mm_storeu_ps(out + i, _mm_mul_ps(r, nr));
     }
+#endif
+    for (; i < n; i++) out[i] = fast_rsqrt(x[i]);
 }
 
-const bool digit_segments[10][7] = {
-    {1,1,1,0,1,1,1}, // 0
-    {0,0,1,0,0,1,0}, // 1
-    {1,0,1,1,1,0,1}, // 2
-    {1,0,1,1,0,1,1}, // 3
-    {0,1,1,1,0,1,0}, // 4
-    {1,1,0,1,0,1,1}, // 5
-    {1,1,0,1,1,1,1}, // 6
-    {1,0,1,0,0,1,0}, // 7
-    {1,1,1,1,1,1,1}, // 8
-    {1,1,1,1,0,1,1}  // 9
-};
+void wrap(float* x, float* y) {
+    *x = fast_wrap(*x, WORLD_W, 1.0f / WORLD_W);
+    *y = fast_wrap(*y, WORLD_H, 1.0f / WORLD_H);
+}
 
-void draw_7segment_digit(int bx, int by, int digit) {
-    if (digit < 0 || digit > 9) return;
-    
-    int w = 20;
-    int h = 32;
-    int thick = 4;
-    
-    if (digit_segments[digit][0]) thick_line(bx, by, bx + w, by, thick);
-    if (digit_segments[digit][1]) thick_line(bx, by, bx, by + h/2, thick);
-    if (digit_segments[digit][2]) thick_line(bx + w, by, bx + w, by + h/2, thick);
-    if (digit_segments[digit][3]) thick_line(bx, by + h/2, bx + w, by + h/2, thick);
-    if (digit_segments[digit][4]) thick_line(bx, by + h/2, bx, by + h, thick);
-    if (digit_segments[digit][5]) thick_line(bx + w, by + h/2, bx + w, by + h, thick);
-    if (digit_segments[digit][6]) thick_line(bx, by + h, bx + w, by + h, thick);
+// Lerp from a to b the short way around a wrapped axis of the given period
+float lerp_wrapped(float a, float b, float t, float period) {
+    float d = b - a;
+    if (d > period / 2) d -= period;
+    else if (d < -period / 2) d += period;
+    return a + d * t;
 }
 
-bool is_critical_overheat() {
-    return ship.heat >= OVERHEAT_MAX * OVERHEAT_CRITICAL_THRESHOLD;
+float distance(float x1, float y1, float x2, float y2) {
+    float dx = x1 - x2;
+    float dy = y1 - y2;
+    if (fabsf(dx) > WORLD_W / 2) dx -= (dx > 0 ? WORLD_W : -WORLD_W);
+    if (fabsf(dy) > WORLD_H / 2) dy -= (dy > 0 ? WORLD_H : -WORLD_H);
+    return fast_hypot(dx, dy);
 }
 
-bool is_overheat_warning() {
-    return ship.heat >= OVERHEAT_MAX * OVERHEAT_WARNING_THRESHOLD;
+// Squared toroidal distance, for range tests that don't need the distance itself
+float distance_sq(float x1, float y1, float x2, float y2) {
+    float dx = x1 - x2;
+    float dy = y1 - y2;
+    if (fabsf(dx) > WORLD_W / 2) dx -= (dx > 0 ? WORLD_W : -WORLD_W);
+    if (fabsf(dy) > WORLD_H / 2) dy -= (dy > 0 ? WORLD_H : -WORLD_H);
+    return dx * dx + dy * dy;
 }
 
-void spawn_cloud() {
-    if (cloud_cnt >= MAX_CLOUDS) return;
-    GasCloud* c = &clouds[cloud_cnt++];
-    c->active = 1;
-    c->size = 18 + (rand() % 32);
-    c->density = 0.65f + (rand() % 35) / 100.0f;
-    c->phase = rand() * 2 * M_PI / RAND_MAX;
-    c->pull_strength = 0.14f + (rand() % 70) / 1000.0f;
-    c->value = 6 + (rand() % 10);
-    
-    int tries = 0;
-    do {
-        c->x = rand() % WINDOW_W;
-        c->y = rand() % WINDOW_H;
-    } while (distance(c->x, c->y, ship.x, ship.y) < 180 && ++tries < 50);
-    
-    float dir = rand() * 2 * M_PI / RAND_MAX;
-    float speed = 0.4f + (rand() % 50) / 100.0f;
-    c->vx = cosf(dir) * speed;
-    c->vy = sinf(dir) * speed;
-    
-    int hue = 140 + rand() % 100;
-    float sat = 0.9f + (rand() % 10)/100.0f;
-    float val = 1.0f;
-    float cmax = val * sat;
-    float hp = hue / 60.0f;
-    float x = cmax * (1 - fabsf(fmodf(hp, 2) - 1));
-    Uint8 r,g,b;
-    if (hp < 1) { r = cmax*255; g = x*255; b = 0; }
-    else if (hp < 2) { r = x*255; g = cmax*255; b = 0; }
-    else if (hp < 3) { r = 0; g = cmax*255; b = x*255; }
-    else if (hp < 4) { r = 0; g = x*255; b = cmax*255; }
-    else if (hp < 5) { r = x*255; g = 0; b = cmax*255; }
-    else { r = cmax*255; g = 0; b = x*255; }
-    c->color = (r << 16) | (g << 8) | b | 0xFF;
+// Bump allocator. All entity pools are carved from one arena at startup so
+// they sit in a single contiguous, cache-line aligned block. Carving from an
+// arena without memory (base NULL) only adds up the size, which is how the
+// arena is measured before it is allocated.
+#define ARENA_ALIGN 64
+#define HUGE_PAGE_SIZE (2u << 20)
+
+typedef struct {
+    Uint8* base;
+    size_t size, used;
+    bool huge;
+} Arena;
+
+Arena world_arena;   // main_world's state, then the render-side buffers
+
+void* arena_alloc(Arena* a, size_t bytes) {
+    size_t at = (a->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    a->used = at + bytes;
+    return a->base ? a->base + at : NULL;
 }
 
-void spawn_creature() {
-    if (creature_cnt >= MAX_CREATURES) return;
-    NebulaCreature* n = &creatures[creature_cnt++];
-    n->active = 1;
-    n->size = 16 + rand() % 26;
-    n->hunt_phase = 0;
-    n->wiggle = rand() * 2 * M_PI / RAND_MAX;
-    n->patrol_phase = rand() * 2 * M_PI / RAND_MAX;
-    
-    n->type = rand() % 3;
-    
-    int tries = 0;
-    do {
-        float side = rand() % 4;
-        if (side == 0) { n->x = -100; n->y = rand() % WINDOW_H; }
-        else if (side == 1) { n->x = WINDOW_W + 100; n->y = rand() % WINDOW_H; }
-        else if (side == 2) { n->y = -100; n->x = rand() % WINDOW_W; }
-        else { n->y = WINDOW_H + 100; n->x = rand() % WINDOW_W; }
-    } while (tries++ < 80 && distance(n->x, n->y, ship.x, ship.y) < 300);
-    
-    float dir_to_ship = atan2f(ship.y - n->y, ship.x - n->x);
-    float offset = (rand() % 100 - 50) / 100.0f * M_PI / 2;
-    float target_dir = dir_to_ship + offset;
-    float target_dist = 300 + rand() % 400;
-    n->target_x = n->x + cosf(target_dir) * target_dist;
-    n->target_y = n->y + sinf(target_dir) * target_dist;
-    
-    float dir = rand() * 2 * M_PI / RAND_MAX;
-    float base_speed = (n->type == 0) ? 0.8f : (n->type == 1) ? 1.4f : 1.0f;
-    n->vx = cosf(dir) * base_speed;
-    n->vy = sinf(dir) * base_speed;
-    n->angle = dir;
-    
-    if (n->type == 0) n->color = 0x88BBFFFF | ((170 + rand() % 50) << 24);
-    else if (n->type == 1) n->color = 0xFF8888FF | ((140 + rand() % 60) << 24);
-    else n->color = 0xCC88FFFF | ((130 + rand() % 70) << 24);
+// Allocates a zeroed arena of at least size bytes. Large arenas are rounded
+// up to and aligned on 2 MB so the kernel can back them with huge pages.
+bool arena_create(Arena* a, size_t size) {
+    size_t align = ARENA_ALIGN;
+    a->huge = size >= HUGE_PAGE_SIZE;
+    if (a->huge) {
+        align = HUGE_PAGE_SIZE;
+        size = (size + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+    }
+    void* p = NULL;
+#if defined(_WIN32)
+    p = _aligned_malloc(size, align);
+#else
+    if (posix_memalign(&p, align, size) != 0) p = NULL;
+#endif
+    if (!p) return false;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (a->huge) madvise(p, size, MADV_HUGEPAGE);
+#endif
+    memset(p, 0, size);
+    a->base = p;
+    a->size = size;
+    a->used = 0;
+    return true;
 }
 
-void spawn_nebula(int idx) {
-    Nebula* n = &nebulas[idx];
-    n->active = true;
-    n->radius = 180 + rand() % 120;
-    n->density = 0.4f + (rand() % 40)/100.0f;
-    n->swirl = rand() * 2 * M_PI / RAND_MAX;
-    n->pulse = 0.0f;
-    n->x = WINDOW_W * (0.2f + (rand() % 1000)/10000.0f * 0.6f) - scrollX * 0.07f;
-    n->y = 100 + rand() % 400;
-    
-    // Dark, starry blue/indigo — subtle, atmospheric, non-distracting
-    int hue = 220 + rand() % 40;              // Deep blue to indigo
-    float sat = 0.35f + (rand() % 15)/100.0f; // Low saturation
-    float val = 0.45f + (rand() % 15)/100.0f; // Dark value
-    float cmax = val * sat;
-    float hp = hue / 60.0f;
-    float x = cmax * (1 - fabsf(fmodf(hp, 2) - 1));
-    Uint8 r,g,b;
-    if (hp < 1) { r = cmax*255; g = x*255; b = 0; }
-    else if (hp < 2) { r = x*255; g = cmax*255; b = 0; }
-    else if (hp < 3) { r = 0; g = cmax*255; b = x*255; }
-    else if (hp < 4) { r = 0; g = x*255; b = cmax*255; }
-    else if (hp < 5) { r = x*255; g = 0; b = cmax*255; }
-    else { r = cmax*255; g = 0; b = x*255; }
-    n->color = (r << 16) | (g << 8) | b | 0x88; // Subtle transparency
+void arena_destroy(Arena* a) {
+#if defined(_WIN32)
+    _aligned_free(a->base);
+#else
+    free(a->base);
+#endif
+    *a = (Arena){0};
 }
 
-void init_game() {
-    srand(time(NULL));
-    ship = (Ship){
-        WINDOW_W / 2.0f, WINDOW_H / 2.0f, 0, 0, -M_PI / 2,
-        1000.0f, 0, 0, 0, 3, false, 0, false, 0,
-        0.0f
-    };
-    cloud_cnt = creature_cnt = particle_cnt = nebula_cnt = 0;
-    frame = 0;
-    scrollX = 0.0f;
-    danger_level = 0.0f;
-    wave = 1;
-    clouds_collected_this_wave = 0;
-    clouds_needed_for_next_wave = CLOUDS_PER_WAVE_BASE;
-    wave_flash_timer = 0;
-    current_wave_display_timer = 0;
-    
-    for (int i = 0; i < 35; i++) spawn_cloud();
-    for (int i = 0; i < MAX_NEBULAE; i++) spawn_nebula(i);
+// Uniform grid over the wrapped world. Entities are linked into per-cell
+// lists by their pool index and only relinked when they cross a cell, so
+// keeping the grid current costs O(1) per moving entity. Radius queries walk
+// the covered cells modulo the grid size, which makes them correct across the
+// wrap seam.
+#define GRID_CELL_SIZE 64
+
+typedef struct {
+    int cols, rows;
+    float cell_w, cell_h;
+    int capacity;
+    int* head;      // per cell, -1 when empty
+    int* next;      // per entity
+    int* prev;
+    int* cell;      // per entity, -1 when not in the grid
+    float* x;
+    float* y;
+} SpatialGrid;
+
+// Cell changes found by a chunked parallel pass, queued per chunk so they can
+// be relinked serially in chunk order afterwards
+typedef struct {
+    int chunk;      // entities per chunk
+    int* index;     // chunk k queues into [k * chunk, (k + 1) * chunk)
+    int* cell;
+    int* count;     // per chunk
+} GridMoves;
+
+enum { RNG_GAMEPLAY, RNG_AI, RNG_FX, RNG_STREAM_COUNT };
+
+typedef struct { Uint32 s[4]; } Rng;
+
+#define EMITTER_PRIORITIES 6
+
+typedef struct {
+    int emitted[EMITTER_COUNT];             // this tick
+    int cursor[EMITTER_PRIORITIES];         // eviction scan position per priority, this tick
+    int tick_start;                         // pool count when the tick began
+    Uint64 spawned[EMITTER_COUNT];
+    Uint64 over_quota[EMITTER_COUNT];
+    Uint64 evicted[EMITTER_COUNT];          // by the victim's emitter
+    Uint64 starved[EMITTER_COUNT];          // pool full and nothing to evict
+} ParticleBudget;
+
+// One game instance: everything update() reads and writes. The pools point
+// into the instance's own block of arena memory, which is all world_reset
+// clears and all a rollback save copies besides the scalars. Simulation code
+// works on `world`, which is per thread: it is main_world unless
+// world_batch_step has pointed it at one of a batch's worlds.
+typedef struct {
+    Ship ship;
+    CloudStore clouds;
+    CreatureStore creatures;
+    Nebula nebulas[MAX_NEBULAE];
+    ParticlePool particles;
+    Planet planets[NUM_PLANETS];
+    Sun sun;
+    SpatialGrid cloud_grid;
+    SpatialGrid creature_grid;
+    GridMoves cloud_moves;
+    GridMoves creature_moves;
+    int* grid_query_buf;
+    Rng rng_streams[RNG_STREAM_COUNT];
+    ParticleBudget particle_budget;
     
-    for (int i = 0; i < NUM_STARS; i++) {
-        stars[i].base_x = (rand() % 90000) - 45000;
-        stars[i].base_y = rand() % WINDOW_H;
-        stars[i].brightness = 110 + rand() % 145;
-        stars[i].phase = rand() % 256;
-        stars[i].size = 1 + (rand() % 3);
-    }
-    for (int i = 0; i < NUM_DEBRIS; i++) {
-        debris[i].base_x = (rand() % 120000) - 60000;
-        debris[i].base_y = rand() % WINDOW_H;
-        debris[i].vx = 0.25f + (rand() % 80)/100.0f;
-        debris[i].size = 1 + rand() % 3;
-    }
+    int nebula_cnt;
+    int frame;
+    float scrollX;
+    float prev_scrollX;
+    float danger_level;
+    int combo_timer;
     
-    for (int i = 0; i < NUM_PLANETS; i++) {
-        planets[i].base_x = 800 + (rand() % 1200);
-        planets[i].base_y = 100 + rand() % 400;
-        planets[i].radius = 28 + rand() % 28;
-        planets[i].color = (rand() % 128 + 64) << 16 | (rand() % 128 + 64) << 8 | (rand() % 255);
-        planets[i].spin = 0;
-    }
+    int wave;
+    int clouds_collected_this_wave;
+    int clouds_needed_for_next_wave;
+    int wave_flash_timer;
+    int current_wave_display_timer;
+    Uint32 starfield_seed;   // the stars and debris are a pure function of this
     
-    sun.base_x = WINDOW_W * 0.7f;
-    sun.base_y = WINDOW_H * 0.25f;
-    sun.radius = 110;
-    sun.pulse_phase = 0;
+    Uint8 (*input_source)();
+    bool prev_tractor;       // the beam engages on the press, not while held
+    Uint8 batch_input;       // this tick's input when driven by a WorldBatch
+    int game_overs;
     
-    for (int i = 0; i < 8; i++) spawn_creature();
+    Uint8* state;            // the block the pools are carved from
+    size_t state_size;
+    bool cosmetics;          // particles and scenery motion, which gameplay never reads
+    bool batched;            // stepped by world_batch_step, one world per worker
+} World;
+
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+World main_world = {.cosmetics = true};
+THREAD_LOCAL World* world = &main_world;
+
+// Carves the grid's arrays; grid_clear must run before first use
+void grid_init(SpatialGrid* g, Arena* a, int capacity) {
+    g->cols = WORLD_W / GRID_CELL_SIZE;
+    g->rows = WORLD_H / GRID_CELL_SIZE;
+    g->cell_w = (float)WORLD_W / g->cols;
+    g->cell_h = (float)WORLD_H / g->rows;
+    g->capacity = capacity;
+    g->head = arena_alloc(a, g->cols * g->rows * sizeof(int));
+    g->next = arena_alloc(a, capacity * sizeof(int));
+    g->prev = arena_alloc(a, capacity * sizeof(int));
+    g->cell = arena_alloc(a, capacity * sizeof(int));
+    g->x = arena_alloc(a, capacity * sizeof(float));
+    g->y = arena_alloc(a, capacity * sizeof(float));
 }
 
-void update() {
-    const Uint8* keys = SDL_GetKeyboardState(NULL);
-    int left = keys[SDL_SCANCODE_A] || keys[SDL_SCANCODE_LEFT];
-    int right = keys[SDL_SCANCODE_D] || keys[SDL_SCANCODE_RIGHT];
-    int thrust = keys[SDL_SCANCODE_W] || keys[SDL_SCANCODE_UP];
-    static bool prev_tractor = false;
-    bool tractor = keys[SDL_SCANCODE_SPACE];
-    
-    frame++;
-    scrollX += 0.9f + danger_level * 0.12f;
-    sun.pulse_phase += 0.018f;
-    danger_level = fminf(1.3f, danger_level + 0.00008f * cloud_cnt);
-    
-    if (tractor && !prev_tractor) ship.tractor_active = true;
-    if (tractor) {
-        ship.tractor_charge += 0.25f;
-        if (!ship.combo_boost_active) ship.fuel -= 0.12f;
-    } else {
-        ship.tractor_active = false;
-        ship.tractor_charge = fmaxf(0, ship.tractor_charge - 0.4f);
-    }
-    prev_tractor = tractor;
-    
-    if (ship.combo >= COMBO_BOOST_THRESHOLD && !ship.combo_boost_active) {
-        ship.combo_boost_active = true;
-        ship.combo_boost_timer = COMBO_BOOST_DURATION;
-    }
-    if (ship.combo_boost_active) {
-        ship.combo_boost_timer--;
-        if (ship.combo_boost_timer <= 0) {
-            ship.combo_boost_active = false;
-        }
-    }
-    
-    for (int i = 0; i < NUM_PLANETS; i++) {
-        planets[i].base_x -= 0.11f + danger_level * 0.007f;
-        if (planets[i].base_x < -400) {
-            planets[i].base_x = WINDOW_W + 600 + rand() % 400;
-            planets[i].base_y = 120 + rand() % 350;
+void grid_clear(SpatialGrid* g) {
+    memset(g->head, 0xFF, g->cols * g->rows * sizeof(int));
+    memset(g->cell, 0xFF, g->capacity * sizeof(int));
+}
+
+int grid_col(SpatialGrid* g, float x) {
+    int c = (int)floorf(x / g->cell_w) % g->cols;
+    return c < 0 ? c + g->cols : c;
+}
+
+int grid_row(SpatialGrid* g, float y) {
+    int r = (int)floorf(y / g->cell_h) % g->rows;
+    return r < 0 ? r + g->rows : r;
+}
+
+void grid_link(SpatialGrid* g, int i, int cell) {
+    g->cell[i] = cell;
+    g->prev[i] = -1;
+    g->next[i] = g->head[cell];
+    if (g->head[cell] >= 0) g->prev[g->head[cell]] = i;
+    g->head[cell] = i;
+}
+
+void grid_remove(SpatialGrid* g, int i) {
+    int cell = g->cell[i];
+    if (cell < 0) return;
+    if (g->prev[i] >= 0) g->next[g->prev[i]] = g->next[i];
+    else g->head[cell] = g->next[i];
+    if (g->next[i] >= 0) g->prev[g->next[i]] = g->prev[i];
+    g->cell[i] = -1;
+}
+
+void grid_insert(SpatialGrid* g, int i, float x, float y) {
+    g->x[i] = x;
+    g->y[i] = y;
+    grid_link(g, i, grid_row(g, y) * g->cols + grid_col(g, x));
+}
+
+int grid_cell(SpatialGrid* g, float x, float y) {
+    return grid_row(g, y) * g->cols + grid_col(g, x);
+}
+
+void grid_update(SpatialGrid* g, int i, float x, float y) {
+    g->x[i] = x;
+    g->y[i] = y;
+    int cell = grid_cell(g, x, y);
+    if (cell == g->cell[i]) return;
+    grid_remove(g, i);
+    grid_link(g, i, cell);
+}
+
+void grid_moves_init(GridMoves* m, Arena* a, int capacity, int chunk) {
+    m->chunk = chunk;
+    m->index = arena_alloc(a, capacity * sizeof(int));
+    m->cell = arena_alloc(a, capacity * sizeof(int));
+    m->count = arena_alloc(a, ((capacity + chunk - 1) / chunk + 1) * sizeof(int));
+}
+
+// Like grid_update, but safe to call from the chunk that owns entity i: the
+// relink is only queued. Each chunk must reset its count before staging.
+void grid_stage(SpatialGrid* g, GridMoves* m, int chunk, int i, float x, float y) {
+    g->x[i] = x;
+    g->y[i] = y;
+    int cell = grid_cell(g, x, y);
+    if (cell == g->cell[i]) return;
+    int j = chunk * m->chunk + m->count[chunk]++;
+    m->index[j] = i;
+    m->cell[j] = cell;
+}
+
+void grid_apply_moves(SpatialGrid* g, GridMoves* m, int chunks) {
+    for (int k = 0; k < chunks; k++) {
+        for (int j = k * m->chunk; j < k * m->chunk + m->count[k]; j++) {
+            grid_remove(g, m->index[j]);
+            grid_link(g, m->index[j], m->cell[j]);
         }
     }
-    
-    if (left) ship.angle -= SHIP_ROT_SPEED;
-    if (right) ship.angle += SHIP_ROT_SPEED;
-    
-    float effective_thrust = SHIP_THRUST;
-    if (is_critical_overheat()) effective_thrust *= OVERHEAT_THRUST_PENALTY;
-    
-    if (thrust && ship.fuel > 5.0f) {
-        ship.vx += cosf(ship.angle) * effective_thrust;
-        ship.vy += sinf(ship.angle) * effective_thrust;
-        ship.fuel -= FUEL_CONSUMPTION;
-        ship.heat += HEAT_GAIN_PER_THRUST;
-        thrust_flame();
-    }
-    
-    float decay = is_critical_overheat() ? HEAT_DECAY_CRITICAL : HEAT_DECAY_NORMAL;
-    ship.heat = fmaxf(0, ship.heat - decay);
-    
-    ship.x += ship.vx;
-    ship.y += ship.vy;
-    
-    if (is_critical_overheat()) {
-        ship.vx *= OVERHEAT_DRAG_MULTIPLIER;
-        ship.vy *= OVERHEAT_DRAG_MULTIPLIER;
-        critical_overheat_effect();
-        
-        ship.overheat_damage_accumulator += OVERHEAT_DAMAGE_PER_SEC / 60.0f;
-        if (ship.overheat_damage_accumulator >= 1.0f) {
-            int damage = (int)ship.overheat_damage_accumulator;
-            ship.lives -= damage;
-            ship.overheat_damage_accumulator -= damage;
-            danger_trail(ship.x, ship.y);
-            if (ship.lives <= 0) {
-                printf("Game Over! (Overheated to death) Final Score: %d\n", ship.score);
-                init_game();
+}
+
+// The entity in slot `from` now lives in slot `to` (swap-remove); `to` must
+// already have been removed from the grid.
+void grid_relocate(SpatialGrid* g, int from, int to) {
+    if (from == to || g->cell[from] < 0) return;
+    int cell = g->cell[from];
+    g->x[to] = g->x[from];
+    g->y[to] = g->y[from];
+    g->cell[to] = cell;
+    g->prev[to] = g->prev[from];
+    g->next[to] = g->next[from];
+    if (g->prev[to] >= 0) g->next[g->prev[to]] = to;
+    else g->head[cell] = to;
+    if (g->next[to] >= 0) g->prev[g->next[to]] = to;
+    g->cell[from] = -1;
+}
+
+int compare_ints(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Collects the entities within toroidal distance r of (x, y) into out, in
+// ascending index order. Returns how many were found.
+int grid_query(SpatialGrid* g, float x, float y, float r, int* out, int max) {
+    int kc = (int)ceilf(r / g->cell_w), kr = (int)ceilf(r / g->cell_h);
+    int c0 = grid_col(g, x) - kc, c1 = grid_col(g, x) + kc;
+    int r0 = grid_row(g, y) - kr, r1 = grid_row(g, y) + kr;
+    if (c1 - c0 + 1 >= g->cols) { c0 = 0; c1 = g->cols - 1; }
+    if (r1 - r0 + 1 >= g->rows) { r0 = 0; r1 = g->rows - 1; }
+    float r2 = r * r;
+    int n = 0;
+    for (int row = r0; row <= r1; row++) {
+        int wr = (row % g->rows + g->rows) % g->rows;
+        for (int col = c0; col <= c1; col++) {
+            int wc = (col % g->cols + g->cols) % g->cols;
+            for (int i = g->head[wr * g->cols + wc]; i >= 0; i = g->next[i]) {
+                if (n < max && distance_sq(g->x[i], g->y[i], x, y) < r2) out[n++] = i;
             }
         }
-    } else {
-        ship.vx *= 0.985f;
-        ship.vy *= 0.985f;
-        ship.overheat_damage_accumulator = fmaxf(0, ship.overheat_damage_accumulator - 0.4f);
     }
-    
-    wrap(&ship.x, &ship.y);
-    trail_emit();
-    
-    ship.fuel = fminf(1000.0f, ship.fuel + 0.35f);
-    
-    for (int i = 0; i < cloud_cnt; i++) {
-        if (!clouds[i].active) continue;
-        GasCloud* c = &clouds[i];
-        
-        float current_range = ship.combo_boost_active ? TRACTOR_RANGE * 1.6f : TRACTOR_RANGE;
-        float current_pull = ship.combo_boost_active ? 1.5f : 1.0f;
-        
-        if (ship.tractor_active && distance(c->x, c->y, ship.x, ship.y) < current_range) {
-            float dx = ship.x - c->x;
-            float dy = ship.y - c->y;
-            float dist = hypotf(dx, dy);
-            if (dist > 0) {
-                float pull = c->pull_strength * fminf(ship.tractor_charge * 0.02f, current_pull);
-                c->vx += (dx / dist) * pull;
-                c->vy += (dy / dist) * pull;
-                tractor_beam_effect(ship.x, ship.y, c->x, c->y);
-            }
-        }
-        
-        c->x += c->vx;
-        c->y += c->vy;
-        c->phase += 0.08f;
-        c->vx *= 0.97f;
-        c->vy *= 0.97f;
-        wrap(&c->x, &c->y);
-        
-        if (distance(c->x, c->y, ship.x, ship.y) < HARVEST_RANGE) {
-            int points = c->value * (1 + ship.combo * 0.2f);
-            ship.score += points;
-            harvest_effect(c->x, c->y, c->value);
-            c->active = 0;
-            clouds[i] = clouds[--cloud_cnt];
-            i--;
-            ship.combo++;
-            combo_timer = 300;
-            clouds_collected_this_wave++;
-            
-            if (clouds_collected_this_wave >= clouds_needed_for_next_wave) {
-                wave++;
-                clouds_collected_this_wave = 0;
-                clouds_needed_for_next_wave = CLOUDS_PER_WAVE_BASE + wave * 18;
-                wave_flash_timer = 180;
-                current_wave_display_timer = 180;
-                
-                for (int j = 0; j < WAVE_CREATURE_BONUS + wave / 2; j++) {
-                    spawn_creature();
-                }
-                
-                danger_level += 0.2f;
-            }
-            continue;
-        }
+    if (n > 32) {
+        qsort(out, n, sizeof(int), compare_ints);
+        return n;
     }
-    
-    while (cloud_cnt < 40 + (int)(danger_level * 35)) spawn_cloud();
-    
-    for (int i = 0; i < creature_cnt; i++) {
-        if (!creatures[i].active) continue;
-        NebulaCreature* n = &creatures[i];
+    for (int a = 1; a < n; a++) {
+        int v = out[a], b = a - 1;
+        while (b >= 0 && out[b] > v) { out[b + 1] = out[b]; b--; }
+        out[b + 1] = v;
+    }
+    return n;
+}
+
+void entity_ids_init(EntityIds* ids, Arena* a, int capacity) {
+    ids->slot_of = arena_alloc(a, capacity * sizeof(int));
+    ids->dense_of = arena_alloc(a, capacity * sizeof(int));
+    ids->generation = arena_alloc(a, capacity * sizeof(Uint32));
+    ids->free_slots = arena_alloc(a, capacity * sizeof(int));
+}
+
+// Frees every slot, handing out slot 0 first. world_reset has zeroed the
+// generations by then, so handles don't outlive init_game.
+void entity_ids_reset(EntityIds* ids, int capacity) {
+    for (int s = 0; s < capacity; s++) {
+        ids->dense_of[s] = -1;
+        ids->free_slots[s] = capacity - 1 - s;
+    }
+    ids->free_cnt = capacity;
+}
+
+void entity_ids_add(EntityIds* ids, int i) {
+    int slot = ids->free_slots[--ids->free_cnt];
+    ids->slot_of[i] = slot;
+    ids->dense_of[slot] = i;
+}
+
+// Entity i is gone and `last` (possibly i itself) moves into its place
+void entity_ids_remove(EntityIds* ids, int i, int last) {
+    int slot = ids->slot_of[i];
+    ids->generation[slot]++;
+    ids->dense_of[slot] = -1;
+    ids->free_slots[ids->free_cnt++] = slot;
+    if (last == i) return;
+    ids->slot_of[i] = ids->slot_of[last];
+    ids->dense_of[ids->slot_of[i]] = i;
+}
+
+Handle entity_handle(const EntityIds* ids, int i) {
+    int slot = ids->slot_of[i];
+    return (Handle){(Uint32)slot, ids->generation[slot]};
+}
+
+// The entity's current index, or -1 if it is gone
+int entity_index(const EntityIds* ids, int capacity, Handle h) {
+    if (h.slot >= (Uint32)capacity || ids->generation[h.slot] != h.generation) return -1;
+    return ids->dense_of[h.slot];
+}
+
+void cloud_store_init(CloudStore* s, Arena* a, int capacity) {
+    s->capacity = capacity;
+    s->motion = arena_alloc(a, capacity * sizeof(Motion));
+    s->prev = arena_alloc(a, capacity * sizeof(SDL_FPoint));
+    s->info = arena_alloc(a, capacity * sizeof(CloudInfo));
+}
+
+void creature_store_init(CreatureStore* s, Arena* a, int capacity) {
+    s->capacity = capacity;
+    s->motion = arena_alloc(a, capacity * sizeof(Motion));
+    s->steer = arena_alloc(a, capacity * sizeof(CreatureSteer));
+    s->prev = arena_alloc(a, capacity * sizeof(Pose));
+    s->info = arena_alloc(a, capacity * sizeof(CreatureInfo));
+}
+
+// Returns the new cloud's index; the caller fills in its components
+int cloud_add(float x, float y) {
+    int i = world->clouds.count++;
+    entity_ids_add(&world->clouds.ids, i);
+    grid_insert(&world->cloud_grid, i, x, y);
+    return i;
+}
+
+void cloud_remove(int i) {
+    int last = --world->clouds.count;
+    grid_remove(&world->cloud_grid, i);
+    world->clouds.motion[i] = world->clouds.motion[last];
+    world->clouds.prev[i] = world->clouds.prev[last];
+    world->clouds.info[i] = world->clouds.info[last];
+    entity_ids_remove(&world->clouds.ids, i, last);
+    grid_relocate(&world->cloud_grid, last, i);
+}
+
+int creature_add(float x, float y) {
+    int i = world->creatures.count++;
+    entity_ids_add(&world->creatures.ids, i);
+    grid_insert(&world->creature_grid, i, x, y);
+    return i;
+}
+
+void creature_remove(int i) {
+    int last = --world->creatures.count;
+    grid_remove(&world->creature_grid, i);
+    world->creatures.motion[i] = world->creatures.motion[last];
+    world->creatures.steer[i] = world->creatures.steer[last];
+    world->creatures.prev[i] = world->creatures.prev[last];
+    world->creatures.info[i] = world->creatures.info[last];
+    entity_ids_remove(&world->creatures.ids, i, last);
+    grid_relocate(&world->creature_grid, last, i);
+}
+
+// Random numbers: xoshiro128** with one independent stream per subsystem, so
+// cosmetic effects can draw as many numbers as they like without shifting
+// gameplay or AI randomness. All streams derive from one 64-bit seed.
+Uint64 rng_seed_value = 0;
+
+Uint64 splitmix64(Uint64* x) {
+    Uint64 z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+void rng_seed_all(Uint64 seed) {
+    rng_seed_value = seed;
+    for (int i = 0; i < RNG_STREAM_COUNT; i++) {
+        Uint64 x = seed ^ (0xD1B54A32D192ED03ull * (i + 1));
+        Uint64 a = splitmix64(&x), b = splitmix64(&x);
+        world->rng_streams[i] = (Rng){{(Uint32)a, (Uint32)(a >> 32), (Uint32)b, (Uint32)(b >> 32)}};
+        if (!(a | b)) world->rng_streams[i].s[0] = 1;
+    }
+}
+
+static inline Uint32 rng_rotl(Uint32 x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+static inline Uint32 rng_next(int stream) {
+    Uint32* s = world->rng_streams[stream].s;
+    Uint32 result = rng_rotl(s[1] * 5, 7) * 9;
+    Uint32 t = s[1] << 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 11);
+    return result;
+}
+
+// Uniform integer in [0, n)
+static inline int rng_int(int stream, int n) {
+    return (int)(((Uint64)rng_next(stream) * (Uint32)n) >> 32);
+}
+
+// Uniform float in [0, 1)
+static inline float rng_float(int stream) {
+    return (rng_next(stream) >> 8) * (1.0f / 16777216.0f);
+}
+
+// Procedural starfield. Each FIELD_TILE_W wide tile of a layer gets its
+// stars or debris from a hash of (seed, layer, tile), so the field is
+// unbounded, nothing is stored, and only the tiles in view are generated.
+#define FIELD_TILE_W 600
+#define FIELD_VIEW_TILES (WORLD_W / FIELD_TILE_W + 1)   // tiles a view can overlap
+
+enum { FIELD_STARS, FIELD_DEBRIS };
+
+Uint64 field_tile_hash(Uint32 seed, int layer, int tile) {
+    Uint64 h = ((Uint64)seed << 32 | (Uint32)tile) ^ (0xD6E8FEB86659FD93ull * (layer + 1));
+    splitmix64(&h);
+    return h;
+}
+
+// Uniform integer in [0, n) from the tile's hash sequence
+int field_int(Uint64* h, int n) {
+    return (int)(((splitmix64(h) >> 32) * (Uint64)n) >> 32);
+}
+
+// Items in one tile: the mean for the density, rounded up or down at random
+int field_tile_count(Uint64* h, int per_screen) {
+    double mean = (double)per_screen * FIELD_TILE_W / WORLD_W;
+    return (int)(mean + (splitmix64(h) >> 11) * 0x1.0p-53);
+}
+
+int field_tile_max(int per_screen) {
+    return (int)((double)per_screen * FIELD_TILE_W / WORLD_W) + 1;
+}
+
+// Generates the stars of `count` tiles starting at `first`, with base_x
+// relative to the left edge of tile `first`. Returns how many there are.
+int field_stars_in(Uint32 seed, int first, int count, Star* out) {
+    int n = 0;
+    for (int t = 0; t < count; t++) {
+        Uint64 h = field_tile_hash(seed, FIELD_STARS, first + t);
+        for (int k = field_tile_count(&h, caps.stars_per_screen); k > 0; k--) {
+            Star* st = &out[n++];
+            st->base_x = (float)(t * FIELD_TILE_W + field_int(&h, FIELD_TILE_W));
+            st->base_y = (float)field_int(&h, WORLD_H);
+            st->brightness = 110 + field_int(&h, 145);
+            st->phase = field_int(&h, 256);
+            st->size = 1 + field_int(&h, 3);
+        }
+    }
+    return n;
+}
+
+int field_debris_in(Uint32 seed, int first, int count, Debris* out) {
+    int n = 0;
+    for (int t = 0; t < count; t++) {
+        Uint64 h = field_tile_hash(seed, FIELD_DEBRIS, first + t);
+        for (int k = field_tile_count(&h, caps.debris_per_screen); k > 0; k--) {
+            Debris* d = &out[n++];
+            d->base_x = (float)(t * FIELD_TILE_W + field_int(&h, FIELD_TILE_W));
+            d->base_y = (float)field_int(&h, WORLD_H);
+            d->vx = 0.25f + field_int(&h, 80) / 100.0f;
+            d->phase = field_int(&h, 256) * (2 * M_PI / 256);
+            d->size = 1 + field_int(&h, 3);
+        }
+    }
+    return n;
+}
+
+void particle_pool_init(ParticlePool* p, Arena* a, int capacity, int slots) {
+    // Round up so the SIMD kernels can always run whole vectors
+    int cap = (slots + 7) & ~7;
+    float** fields[] = {&p->x, &p->y, &p->vx, &p->vy, &p->life, &p->grav, &p->prev_x, &p->prev_y};
+    p->count = 0;
+    p->capacity = capacity;
+    p->slots = slots;
+    for (int i = 0; i < (int)SDL_arraysize(fields); i++) *fields[i] = arena_alloc(a, cap * sizeof(float));
+    p->color = arena_alloc(a, cap * sizeof(Uint32));
+    p->emitter = arena_alloc(a, cap);
+    memset(p->live, 0, sizeof(p->live));
+}
+
+void particle_pool_set(ParticlePool* p, int i, int emitter, float x, float y, float vx, float vy, Uint32 color, float life) {
+    p->x[i] = p->prev_x[i] = x;
+    p->y[i] = p->prev_y[i] = y;
+    p->vx[i] = vx;
+    p->vy[i] = vy;
+    p->life[i] = life;
+    p->grav[i] = 0.06f * ((color >> 24) / 255.0f);
+    p->color[i] = color;
+    p->emitter[i] = emitter;
+}
+
+bool particle_pool_spawn(ParticlePool* p, int emitter, float x, float y, float vx, float vy, Uint32 color, float life) {
+    if (p->count >= p->slots) return false;
+    particle_pool_set(p, p->count++, emitter, x, y, vx, vy, color, life);
+    p->live[emitter]++;
+    return true;
+}
+
+// Particle budget. Each effect has a priority and a per-tick emission quota,
+// a share of the pool capacity, so the number of particles spawned per tick
+// has a fixed upper bound (the sum of the quotas) no matter how many clouds
+// the tractor sweeps. When the pool is full, a new particle evicts the
+// oldest particle of the lowest priority up to its own, short of ones its own
+// effect spawned this tick; if there is none it is dropped. The pool is kept
+// in spawn order, so the oldest particle of a priority is the first one
+// found scanning from the front: an evicted particle is only marked dead and
+// the newcomer appended, and particles_compact drops the dead at the end of
+// the tick. The pool has room for a tick's worth of quotas beyond its
+// capacity for that. The scan cursors only move forward within a tick, so
+// evictions cost O(capacity) per priority per tick at most.
+typedef struct {
+    const char* name;
+    int priority;   // higher survives
+    int share;      // quota in particles per tick per 1000 of capacity
+} EmitterInfo;
+
+EmitterInfo emitters[EMITTER_COUNT] = {
+    [EMIT_HARVEST]  = {"harvest",  4, 200},
+    [EMIT_DANGER]   = {"danger",   5, 60},
+    [EMIT_OVERHEAT] = {"overheat", 3, 20},
+    [EMIT_THRUST]   = {"thrust",   2, 20},
+    [EMIT_TRAIL]    = {"trail",    1, 10},
+    [EMIT_TRACTOR]  = {"tractor",  0, 60},
+};
+
+int emitter_quota(int capacity, int emitter) {
+    return SDL_max(1, capacity * emitters[emitter].share / 1000);
+}
+
+// Array room for a pool of the given capacity
+int particle_slots(int capacity) {
+    int slots = capacity;
+    for (int e = 0; e < EMITTER_COUNT; e++) slots += emitter_quota(capacity, e);
+    return slots;
+}
+
+int particles_live(const ParticlePool* p) {
+    int n = 0;
+    for (int e = 0; e < EMITTER_COUNT; e++) n += p->live[e];
+    return n;
+}
+
+void particle_budget_begin_tick() {
+    memset(world->particle_budget.emitted, 0, sizeof(world->particle_budget.emitted));
+    memset(world->particle_budget.cursor, 0, sizeof(world->particle_budget.cursor));
+    world->particle_budget.tick_start = world->particles.count;
+}
+
+// Marks the oldest particle the emitter may replace as dead
+bool particle_evict(ParticlePool* p, ParticleBudget* b, int emitter) {
+    int own = emitters[emitter].priority;
+    for (int prio = 0; prio <= own; prio++) {
+        int* i = &b->cursor[prio];
+        int end = prio == own ? b->tick_start : p->count;
+        while (*i < end && (emitters[p->emitter[*i]].priority != prio || p->life[*i] <= 0)) (*i)++;
+        if (*i >= end) continue;
+        int victim = p->emitter[*i];
+        p->life[(*i)++] = 0;
+        p->live[victim]--;
+        b->evicted[victim]++;
+        return true;
+    }
+    return false;
+}
+
+void spawn_particle(int emitter, float x, float y, float vx, float vy, Uint32 color, float life) {
+    ParticleBudget* b = &world->particle_budget;
+    ParticlePool* p = &world->particles;
+    if (b->emitted[emitter] >= emitter_quota(p->capacity, emitter)) {
+        b->over_quota[emitter]++;
+        return;
+    }
+    b->emitted[emitter]++;
+    if ((particles_live(p) >= p->capacity && !particle_evict(p, b, emitter)) ||
+        !particle_pool_spawn(p, emitter, x, y, vx, vy, color, life)) {
+        b->starved[emitter]++;
+        return;
+    }
+    b->spawned[emitter]++;
+}
+
+// How many of `want` particles the emitter still has quota for this tick.
+// An effect that lays a burst out over a shape asks first and spreads what
+// it gets, so a burst past the quota comes out sparser rather than cut off.
+int particle_allowance(int emitter, int want) {
+    ParticleBudget* b = &world->particle_budget;
+    int left = emitter_quota(world->particles.capacity, emitter) - b->emitted[emitter];
+    int n = want < left ? want : SDL_max(left, 0);
+    b->over_quota[emitter] += want - n;
+    return n;
+}
+
+void particle_budget_report() {
+    ParticleBudget* b = &world->particle_budget;
+    printf("Particles: %d/%d live\n", world->particles.count, world->particles.capacity);
+    for (int e = 0; e < EMITTER_COUNT; e++) {
+        printf("  %-8s prio %d quota %3d: %4d live, %llu spawned, %llu over quota, %llu evicted, %llu starved\n",
+               emitters[e].name, emitters[e].priority, emitter_quota(world->particles.capacity, e), world->particles.live[e],
+               (unsigned long long)b->spawned[e], (unsigned long long)b->over_quota[e],
+               (unsigned long long)b->evicted[e], (unsigned long long)b->starved[e]);
+    }
+}
+
+// Advances particles [begin, end) by one tick: move, apply gravity and drag,
+// age, and wrap around the world. Velocities are far below the world size, so
+// a single conditional add/subtract replaces wrap()'s fmodf.
+void particles_integrate_scalar(ParticlePool* p, int begin, int end) {
+    for (int i = begin; i < end; i++) {
+        float x = p->x[i] + p->vx[i];
+        float y = p->y[i] + p->vy[i];
+        p->vy[i] += p->grav[i];
+        p->vx[i] *= 0.98f;
+        p->life[i] -= 1.2f;
+        if (x < 0) x += WORLD_W; else if (x >= WORLD_W) x -= WORLD_W;
+        if (y < 0) y += WORLD_H; else if (y >= WORLD_H) y -= WORLD_H;
+        p->x[i] = x;
+        p->y[i] = y;
+    }
+}
+
+void particles_integrate(ParticlePool* p, int begin, int end) {
+    int i = begin;
+#if defined(__AVX2__)
+    const __m256 zero = _mm256_setzero_ps(), drag = _mm256_set1_ps(0.98f), age = _mm256_set1_ps(1.2f);
+    const __m256 ww = _mm256_set1_ps(WORLD_W), wh = _mm256_set1_ps(WORLD_H);
+    for (; i + 8 <= end; i += 8) {
+        __m256 vx = _mm256_loadu_ps(p->vx + i), vy = _mm256_loadu_ps(p->vy + i);
+        __m256 x = _mm256_add_ps(_mm256_loadu_ps(p->x + i), vx);
+        __m256 y = _mm256_add_ps(_mm256_loadu_ps(p->y + i), vy);
+        _mm256_storeu_ps(p->vy + i, _mm256_add_ps(vy, _mm256_loadu_ps(p->grav + i)));
+        _mm256_storeu_ps(p->vx + i, _mm256_mul_ps(vx, drag));
+        _mm256_storeu_ps(p->life + i, _mm256_sub_ps(_mm256_loadu_ps(p->life + i), age));
+        x = _mm256_add_ps(x, _mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_LT_OQ), ww));
+        x = _mm256_sub_ps(x, _mm256_and_ps(_mm256_cmp_ps(x, ww, _CMP_GE_OQ), ww));
+        y = _mm256_add_ps(y, _mm256_and_ps(_mm256_cmp_ps(y, zero, _CMP_LT_OQ), wh));
+        y = _mm256_sub_ps(y, _mm256_and_ps(_mm256_cmp_ps(y, wh, _CMP_GE_OQ), wh));
+        _mm256_storeu_ps(p->x + i, x);
+        _mm256_storeu_ps(p->y + i, y);
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 zero = _mm_setzero_ps(), drag = _mm_set1_ps(0.98f), age = _mm_set1_ps(1.2f);
+    const __m128 ww = _mm_set1_ps(WORLD_W), wh = _mm_set1_ps(WORLD_H);
+    for (; i + 4 <= end; i += 4) {
+        __m128 vx = _mm_loadu_ps(p->vx + i), vy = _mm_loadu_ps(p->vy + i);
+        __m128 x = _mm_add_ps(_mm_loadu_ps(p->x + i), vx);
+        __m128 y = _mm_add_ps(_mm_loadu_ps(p->y + i), vy);
+        _mm_storeu_ps(p->vy + i, _mm_add_ps(vy, _mm_loadu_ps(p->grav + i)));
+        _mm_storeu_ps(p->vx + i, _mm_mul_ps(vx, drag));
+        _mm_storeu_ps(p->life + i, _mm_sub_ps(_mm_loadu_ps(p->life + i), age));
+        x = _mm_add_ps(x, _mm_and_ps(_mm_cmplt_ps(x, zero), ww));
+        x = _mm_sub_ps(x, _mm_and_ps(_mm_cmpge_ps(x, ww), ww));
+        y = _mm_add_ps(y, _mm_and_ps(_mm_cmplt_ps(y, zero), wh));
+        y = _mm_sub_ps(y, _mm_and_ps(_mm_cmpge_ps(y, wh), wh));
+        _mm_storeu_ps(p->x + i, x);
+        _mm_storeu_ps(p->y + i, y);
+    }
+#endif
+    particles_integrate_scalar(p, i, end);
+}
+
+// Removes dead particles, keeping the survivors in spawn order
+void particles_compact(ParticlePool* p) {
+    int n = 0;
+    memset(p->live, 0, sizeof(p->live));
+    for (int i = 0; i < p->count; i++) {
+        if (p->life[i] <= 0) continue;
+        p->live[p->emitter[i]]++;
+        if (n != i) {
+            p->x[n] = p->x[i];
+            p->y[n] = p->y[i];
+            p->vx[n] = p->vx[i];
+            p->vy[n] = p->vy[i];
+            p->life[n] = p->life[i];
+            p->grav[n] = p->grav[i];
+            p->prev_x[n] = p->prev_x[i];
+            p->prev_y[n] = p->prev_y[i];
+            p->color[n] = p->color[i];
+            p->emitter[n] = p->emitter[i];
+        }
+        n++;
+    }
+    p->count = n;
+}
+
+void harvest_effect(float x, float y, int intensity) {
+    if (!world->cosmetics) return;
+    int n = particle_allowance(EMIT_HARVEST, 30 + intensity * 15);
+    for (int i = 0; i < n; i++) {
+        float ang = (float)i / n * 2 * M_PI;
+        float speed = 3.5f + (rng_int(RNG_FX, 90)) / 30.0f;
+        Uint32 c = 0xAAEEFFAA | ((rng_int(RNG_FX, 120) + 135) << 24);
+        spawn_particle(EMIT_HARVEST, x, y, fast_cos(ang) * speed, fast_sin(ang) * speed * 0.7f, c, 60 + rng_int(RNG_FX, 50));
+    }
+}
+
+void tractor_beam_effect(float x1, float y1, float x2, float y2) {
+    if (!world->cosmetics) return;
+    for (int i = 0; i < 18; i++) {
+        float t = (float)i / 18.0f + (rng_int(RNG_FX, 20))/1000.0f;
+        float px = x1 + (x2 - x1) * t;
+        float py = y1 + (y2 - y1) * t;
+        float jitter_x = (rng_int(RNG_FX, 40) - 20) * 0.15f;
+        float jitter_y = (rng_int(RNG_FX, 40) - 20) * 0.15f;
+        Uint32 c = 0xCCEEFFFF | ((200 + (int)(fast_sin(world->frame * 0.5f + i) * 55)) << 24);
+        spawn_particle(EMIT_TRACTOR, px + jitter_x, py + jitter_y, (rng_int(RNG_FX, 40) - 20) * 0.2f, (rng_int(RNG_FX, 40) - 20) * 0.2f, c, 40 + rng_int(RNG_FX, 20));
+    }
+}
+
+void danger_trail(float x, float y) {
+    if (!world->cosmetics) return;
+    for (int i = 0; i < 8; i++) {
+        float ang = (rng_int(RNG_FX, 360)) * M_PI / 180.0f;
+        float speed = 5.0f + (rng_int(RNG_FX, 50)) / 10.0f;
+        Uint32 c = 0xFF4444FF | ((rng_int(RNG_FX, 100) + 140) << 24);
+        spawn_particle(EMIT_DANGER, x, y, fast_cos(ang) * speed, fast_sin(ang) * speed, c, 30 + rng_int(RNG_FX, 25));
+    }
+}
+
+void critical_overheat_effect() {
+    if (!world->cosmetics) return;
+    float rear = world->ship.angle + M_PI;
+    for (int i = 0; i < 8; i++) {
+        float ang = rear + (rng_int(RNG_FX, 100) - 50) * 0.018f;
+        float spd = 3.5f + (rng_int(RNG_FX, 60))/10.0f;
+        Uint32 c = 0xAA444444 | ((90 + rng_int(RNG_FX, 80)) << 24);
+        spawn_particle(EMIT_OVERHEAT, world->ship.x + fast_cos(rear)*20, world->ship.y + fast_sin(rear)*20,
+                       fast_cos(ang)*spd + world->ship.vx*0.3f, fast_sin(ang)*spd + world->ship.vy*0.3f,
+                       c, 60 + rng_int(RNG_FX, 50));
+    }
+    if (world->frame % 4 == 0) {
+        for (int i = 0; i < 5; i++) {
+            float ang = rng_float(RNG_FX) * 2 * M_PI;
+            float spd = 4.5f + (rng_int(RNG_FX, 60))/10.0f;
+            Uint32 c = 0xFFFF8800 | ((180 + rng_int(RNG_FX, 75)) << 24);
+            spawn_particle(EMIT_OVERHEAT, world->ship.x, world->ship.y,
+                           fast_cos(ang)*spd, fast_sin(ang)*spd,
+                           c, 30 + rng_int(RNG_FX, 25));
+        }
+    }
+}
+
+void thrust_flame() {
+    if (!world->cosmetics) return;
+    float rear = world->ship.angle + M_PI;
+    float px = world->ship.x + fast_cos(rear) * 22;
+    float py = world->ship.y + fast_sin(rear) * 22;
+    for (int i = 0; i < 14; i++) {
+        float ang = rear + (rng_int(RNG_FX, 120) - 60) * 0.015f;
+        float spd = 7.0f + (rng_int(RNG_FX, 70)) / 10.0f;
+        Uint32 c = (rng_int(RNG_FX, 3) == 0) ? 0xFFAA88FF : 0xEEFFCCFF;
+        spawn_particle(EMIT_THRUST, px, py, fast_cos(ang) * spd + world->ship.vx * 0.25f, fast_sin(ang) * spd + world->ship.vy * 0.25f, c, 30 + rng_int(RNG_FX, 25));
+    }
+}
+
+void trail_emit() {
+    if (!world->cosmetics) return;
+    float speed = fast_hypot(world->ship.vx, world->ship.vy);
+    if (speed < 3.5f || world->frame % 3 != 0) return;
+    float rear = fast_atan2(world->ship.vy, world->ship.vx) + M_PI;
+    float px = world->ship.x + fast_cos(rear) * 20;
+    float py = world->ship.y + fast_sin(rear) * 20;
+    for (int i = 0; i < 5; i++) {
+        float ang = rear + (rng_int(RNG_FX, 100) - 50) * 0.012f;
+        spawn_particle(EMIT_TRAIL, px, py, fast_cos(ang) * (2.0f + speed * 0.3f), fast_sin(ang) * (2.0f + speed * 0.3f), 0x66DDFFFF, 40 + rng_int(RNG_FX, 35));
+    }
+}
+
+// Internal render resolution: frames are drawn at render_scale times the
+// world size, into an offscreen target when that differs from the window.
+#define RENDER_SCALE_MIN  0.25f
+#define RENDER_SCALE_MAX  4.0f
+#define RENDER_SCALE_STEP 0.125f   // per dynamic-resolution change
+#define RENDER_DYNAMIC_MIN 0.5f
+
+float render_scale = 1.0f;
+float render_scale_max = 1.0f;     // where dynamic resolution climbs back to
+int render_w = WORLD_W, render_h = WORLD_H;
+bool dynamic_resolution = false;
+
+void set_render_scale(float scale) {
+    render_scale = SDL_max(RENDER_SCALE_MIN, SDL_min(scale, RENDER_SCALE_MAX));
+    render_w = (int)(WORLD_W * render_scale + 0.5f);
+    render_h = (int)(WORLD_H * render_scale + 0.5f);
+}
+
+// Render paths, cycled with F1:
+//  - immediate: one SDL_RenderDraw* call per primitive (the original path)
+//  - batched:   primitives become quads in one vertex buffer submitted with
+//               SDL_RenderGeometry; scanlines keep their exact 1px rows
+//  - software:  primitives are rasterized on the CPU by worker threads into a
+//               framebuffer that is uploaded once per frame
+enum { RENDER_IMMEDIATE, RENDER_BATCHED, RENDER_SOFTWARE, RENDER_PATH_COUNT };
+const char* render_path_names[RENDER_PATH_COUNT] = {"immediate", "batched geometry", "software"};
+
+#define BATCH_MAX_QUADS 16384
+
+int render_path = RENDER_BATCHED;
+SDL_Vertex batch_verts[BATCH_MAX_QUADS * 4];
+int batch_indices[BATCH_MAX_QUADS * 6];
+int batch_quad_cnt = 0;
+int batch_submits = 0;
+SDL_Color draw_color = {255, 255, 255, 255};
+
+void batch_init() {
+    for (int q = 0; q < BATCH_MAX_QUADS; q++) {
+        int* idx = &batch_indices[q * 6];
+        idx[0] = q * 4;     idx[1] = q * 4 + 1; idx[2] = q * 4 + 2;
+        idx[3] = q * 4 + 2; idx[4] = q * 4 + 3; idx[5] = q * 4;
+    }
+}
+
+void gfx_flush() {
+    if (batch_quad_cnt == 0) return;
+    SDL_RenderGeometry(renderer, NULL, batch_verts, batch_quad_cnt * 4, batch_indices, batch_quad_cnt * 6);
+    PROF_DRAW_CALL();
+    batch_quad_cnt = 0;
+    batch_submits++;
+}
+
+void batch_quad(float x0, float y0, float x1, float y1, float x2, float y2, float x3, float y3) {
+    if (batch_quad_cnt >= BATCH_MAX_QUADS) gfx_flush();
+    SDL_Vertex* v = &batch_verts[batch_quad_cnt++ * 4];
+    v[0] = (SDL_Vertex){{x0, y0}, draw_color, {0, 0}};
+    v[1] = (SDL_Vertex){{x1, y1}, draw_color, {0, 0}};
+    v[2] = (SDL_Vertex){{x2, y2}, draw_color, {0, 0}};
+    v[3] = (SDL_Vertex){{x3, y3}, draw_color, {0, 0}};
+}
+
+void batch_rect(float x, float y, float w, float h) {
+    batch_quad(x, y, x + w, y, x + w, y + h, x, y + h);
+}
+
+// Segment between pixel centers, half_w wide on each side and extended by
+// half a pixel at both ends so it covers the same pixels as a drawn line.
+void batch_segment(int x1, int y1, int x2, int y2, float half_w) {
+    float dx = x2 - x1, dy = y2 - y1;
+    float len_sq = dx * dx + dy * dy;
+    if (len_sq < 0.25f) {
+        batch_rect(x1 + 0.5f - half_w, y1 + 0.5f - half_w, half_w * 2, half_w * 2);
+        return;
+    }
+    float inv = fast_rsqrt(len_sq);
+    float ux = dx * inv * 0.5f, uy = dy * inv * 0.5f;
+    float nx = -dy * inv * half_w, ny = dx * inv * half_w;
+    float ax = x1 + 0.5f - ux, ay = y1 + 0.5f - uy;
+    float bx = x2 + 0.5f + ux, by = y2 + 0.5f + uy;
+    batch_quad(ax + nx, ay + ny, bx + nx, by + ny, bx - nx, by - ny, ax - nx, ay - ny);
+}
+
+// Thread pool: pool_run() calls fn(ctx, i) for i in [0, count) across the
+// workers and the calling thread, and returns once all tasks are done.
+// Every participating thread owns a contiguous range of task indices and
+// works through it front to back; once its own range is exhausted it steals
+// from the other ranges through the same atomic cursor. Neighbouring tasks
+// thus mostly stay on one thread, while an uneven split or a thread that
+// starts late is still balanced out.
+#define MAX_WORKERS 32
+
+typedef void (*TaskFn)(void* ctx, int index);
+
+typedef struct {
+    SDL_atomic_t next;
+    int end;
+    Uint8 pad[64 - sizeof(SDL_atomic_t) - sizeof(int)];   // one cache line per range
+} TaskRange;
+
+typedef struct {
+    SDL_Thread* threads[MAX_WORKERS];
+    int thread_cnt;
+    SDL_sem* start;
+    SDL_sem* done;
+    TaskRange ranges[MAX_WORKERS + 1];
+    int range_cnt;
+    SDL_atomic_t joined;
+    TaskFn fn;
+    void* ctx;
+    World* world;   // the caller's, which the tasks run in
+    bool quit;
+} ThreadPool;
+
+ThreadPool thread_pool;
+int worker_threads = -1;   // -1 = one per core beyond the main thread
+
+void pool_work(ThreadPool* pool, int self) {
+    for (int k = 0; k < pool->range_cnt; k++) {
+        TaskRange* r = &pool->ranges[(self + k) % pool->range_cnt];
+        int i;
+        while ((i = SDL_AtomicAdd(&r->next, 1)) < r->end) pool->fn(pool->ctx, i);
+    }
+}
+
+int pool_worker(void* data) {
+    ThreadPool* pool = data;
+    for (;;) {
+        SDL_SemWait(pool->start);
+        if (pool->quit) break;
+        world = pool->world;
+        pool_work(pool, SDL_AtomicAdd(&pool->joined, 1));
+        SDL_SemPost(pool->done);
+    }
+    return 0;
+}
+
+void pool_init(ThreadPool* pool, int threads) {
+    if (threads < 0) threads = SDL_GetCPUCount() - 1;
+    if (threads > MAX_WORKERS) threads = MAX_WORKERS;
+    pool->start = SDL_CreateSemaphore(0);
+    pool->done = SDL_CreateSemaphore(0);
+    pool->thread_cnt = 0;
+    for (int i = 0; i < threads; i++) {
+        pool->threads[i] = SDL_CreateThread(pool_worker, "worker", pool);
+        if (!pool->threads[i]) break;
+        pool->thread_cnt++;
+    }
+}
+
+void pool_run(ThreadPool* pool, TaskFn fn, void* ctx, int count) {
+    if (count <= 0) return;
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->world = world;
+    int helpers = pool->thread_cnt < count - 1 ? pool->thread_cnt : count - 1;
+    pool->range_cnt = helpers + 1;
+    for (int r = 0; r < pool->range_cnt; r++) {
+        SDL_AtomicSet(&pool->ranges[r].next, (int)((long long)count * r / pool->range_cnt));
+        pool->ranges[r].end = (int)((long long)count * (r + 1) / pool->range_cnt);
+    }
+    SDL_AtomicSet(&pool->joined, 1);
+    for (int i = 0; i < helpers; i++) SDL_SemPost(pool->start);
+    pool_work(pool, 0);
+    for (int i = 0; i < helpers; i++) SDL_SemWait(pool->done);
+}
+
+void pool_shutdown(ThreadPool* pool) {
+    pool->quit = true;
+    for (int i = 0; i < pool->thread_cnt; i++) SDL_SemPost(pool->start);
+    for (int i = 0; i < pool->thread_cnt; i++) SDL_WaitThread(pool->threads[i], NULL);
+    SDL_DestroySemaphore(pool->start);
+    SDL_DestroySemaphore(pool->done);
+    pool->thread_cnt = 0;
+}
+
+// Software rasterizer: draw calls are recorded as commands, binned into
+// horizontal bands, and each band is rasterized by one worker in command
+// order, so the result does not depend on the thread count. Blending follows
+// SDL_BLENDMODE_BLEND onto an opaque target.
+#define SW_BAND_H 16
+
+enum { SW_CLEAR, SW_RECT, SW_LINE };
+
+typedef struct {
+    Uint8 type;
+    Uint32 color;            // ARGB
+    Sint16 x1, y1, x2, y2;   // rect: inclusive corners; line: endpoints
+} SwCmd;
+
+typedef struct {
+    Uint32* fb;
+    int w, h;                // framebuffer size, at the render resolution
+    float scale_x, scale_y;  // framebuffer pixels per world unit
+    SDL_Texture* tex;
+    SwCmd* cmds;
+    int cmd_cnt, cmd_cap;
+    int band_cnt;
+    int* band_start;
+    int* band_fill;
+    int* band_cmds;
+    int band_cmds_cap;
+} SoftRaster;
+
+SoftRaster sw;
+
+// (Re)allocates the framebuffer for the current render resolution
+bool sw_init() {
+    if (sw.fb && sw.w == render_w && sw.h == render_h) return true;
+    SDL_SIMDFree(sw.fb);
+    free(sw.band_start);
+    free(sw.band_fill);
+    if (sw.tex) SDL_DestroyTexture(sw.tex);
+    sw.w = render_w;
+    sw.h = render_h;
+    sw.scale_x = (float)sw.w / WORLD_W;
+    sw.scale_y = (float)sw.h / WORLD_H;
+    sw.fb = SDL_SIMDAlloc(sw.w * sw.h * sizeof(Uint32));
+    sw.band_cnt = (sw.h + SW_BAND_H - 1) / SW_BAND_H;
+    sw.band_start = calloc(sw.band_cnt + 1, sizeof(int));
+    sw.band_fill = calloc(sw.band_cnt, sizeof(int));
+    sw.tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, sw.w, sw.h);
+    if (!sw.fb || !sw.band_start || !sw.band_fill || !sw.tex) {
+        fprintf(stderr, "Software rasterizer unavailable: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+void sw_push(Uint8 type, int x1, int y1, int x2, int y2) {
+    if (sw.cmd_cnt == sw.cmd_cap) {
+        int cap = sw.cmd_cap ? sw.cmd_cap * 2 : 4096;
+        SwCmd* cmds = realloc(sw.cmds, cap * sizeof(SwCmd));
+        if (!cmds) return;
+        sw.cmds = cmds;
+        sw.cmd_cap = cap;
+    }
+    Uint32 color = ((Uint32)draw_color.a << 24) | (draw_color.r << 16) | (draw_color.g << 8) | draw_color.b;
+    sw.cmds[sw.cmd_cnt++] = (SwCmd){type, color, x1, y1, x2, y2};
+}
+
+// World to framebuffer coordinates
+int sw_x(float x) {
+    return (int)floorf(x * sw.scale_x);
+}
+
+int sw_y(float y) {
+    return (int)floorf(y * sw.scale_y);
+}
+
+// Takes world coordinates; anything it covers gets at least one pixel
+void sw_rect(int x, int y, int w, int h) {
+    if (w <= 0 || h <= 0) return;
+    int x1 = sw_x(x), y1 = sw_y(y);
+    int x2 = SDL_max(x1, sw_x(x + w) - 1), y2 = SDL_max(y1, sw_y(y + h) - 1);
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 >= sw.w) x2 = sw.w - 1;
+    if (y2 >= sw.h) y2 = sw.h - 1;
+    if (x1 > x2 || y1 > y2 || draw_color.a == 0) return;
+    sw_push(SW_RECT, x1, y1, x2, y2);
+}
+
+void sw_line(int x1, int y1, int x2, int y2) {
+    if (y1 == y2) {
+        sw_rect(x1 < x2 ? x1 : x2, y1, abs(x2 - x1) + 1, 1);
+    } else if (x1 == x2) {
+        sw_rect(x1, y1 < y2 ? y1 : y2, 1, abs(y2 - y1) + 1);
+    } else {
+        if ((x1 < 0 && x2 < 0) || (x1 >= WORLD_W && x2 >= WORLD_W)) return;
+        if ((y1 < 0 && y2 < 0) || (y1 >= WORLD_H && y2 >= WORLD_H)) return;
+        if (draw_color.a == 0) return;
+        sw_push(SW_LINE, sw_x(x1), sw_y(y1), sw_x(x2), sw_y(y2));
+    }
+}
+
+void sw_clear(Uint8 r, Uint8 g, Uint8 b) {
+    sw.cmd_cnt = 0;
+    draw_color = (SDL_Color){r, g, b, 255};
+    sw_push(SW_CLEAR, 0, 0, sw.w - 1, sw.h - 1);
+}
+
+// dst = src * a + dst * (1 - a), per channel, rounded; the target stays opaque
+void sw_blend_span(Uint32* dst, int n, Uint32 color) {
+    Uint32 a = color >> 24;
+    if (a == 255) {
+        for (int i = 0; i < n; i++) dst[i] = color;
+        return;
+    }
+    Uint32 inv = 255 - a;
+    Uint32 sr = ((color >> 16) & 255) * a + 128;
+    Uint32 sg = ((color >> 8) & 255) * a + 128;
+    Uint32 sb = (color & 255) * a + 128;
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i zero8 = _mm256_setzero_si256();
+    const __m256i src8 = _mm256_set_epi16(0, sr, sg, sb, 0, sr, sg, sb, 0, sr, sg, sb, 0, sr, sg, sb);
+    const __m256i inv8 = _mm256_set1_epi16(inv);
+    const __m256i opaque8 = _mm256_set1_epi32(0xFF000000);
+    for (; i + 8 <= n; i += 8) {
+        __m256i d = _mm256_loadu_si256((__m256i*)(dst + i));
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero8), inv8), src8);
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero8), inv8), src8);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(_mm256_packus_epi16(lo, hi), opaque8));
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i src = _mm_set_epi16(0, sr, sg, sb, 0, sr, sg, sb);
+    const __m128i inv4 = _mm_set1_epi16(inv);
+    const __m128i opaque = _mm_set1_epi32(0xFF000000);
+    for (; i + 4 <= n; i += 4) {
+        __m128i d = _mm_loadu_si128((__m128i*)(dst + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inv4), src);
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inv4), src);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+    }
+#endif
+    for (; i < n; i++) {
+        Uint32 d = dst[i];
+        Uint32 r = ((d >> 16) & 255) * inv + sr;
+        Uint32 g = ((d >> 8) & 255) * inv + sg;
+        Uint32 b = (d & 255) * inv + sb;
+        r = (r + (r >> 8)) >> 8;
+        g = (g + (g >> 8)) >> 8;
+        b = (b + (b >> 8)) >> 8;
+        dst[i] = 0xFF000000 | (r << 16) | (g << 8) | b;
+    }
+}
+
+void sw_raster_line(const SwCmd* c, int band_y0, int band_y1) {
+    int x = c->x1, y = c->y1;
+    int dx = abs(c->x2 - c->x1), dy = -abs(c->y2 - c->y1);
+    int sx = c->x1 < c->x2 ? 1 : -1, sy = c->y1 < c->y2 ? 1 : -1;
+    int err = dx + dy;
+    for (;;) {
+        if (y >= band_y0 && y < band_y1 && x >= 0 && x < sw.w)
+            sw_blend_span(&sw.fb[y * sw.w + x], 1, c->color);
+        if (x == c->x2 && y == c->y2) break;
+        // Past the band in the direction of travel: nothing more to plot
+        if ((sy > 0 && y >= band_y1) || (sy < 0 && y < band_y0)) break;
+        int e2 = 2 * err;
+        if (e2 >= dy) { err += dy; x += sx; }
+        if (e2 <= dx) { err += dx; y += sy; }
+    }
+}
+
+void sw_raster_band(void* ctx, int band) {
+    int y0 = band * SW_BAND_H;
+    int y1 = y0 + SW_BAND_H < sw.h ? y0 + SW_BAND_H : sw.h;
+    for (int k = sw.band_start[band]; k < sw.band_start[band + 1]; k++) {
+        const SwCmd* c = &sw.cmds[sw.band_cmds[k]];
+        if (c->type == SW_LINE) {
+            sw_raster_line(c, y0, y1);
+            continue;
+        }
+        int ya = c->y1 > y0 ? c->y1 : y0;
+        int yb = c->y2 < y1 - 1 ? c->y2 : y1 - 1;
+        for (int y = ya; y <= yb; y++)
+            sw_blend_span(&sw.fb[y * sw.w + c->x1], c->x2 - c->x1 + 1, c->color);
+    }
+}
+
+int sw_band_of(int y) {
+    if (y < 0) return 0;
+    if (y >= sw.h) return sw.band_cnt - 1;
+    return y / SW_BAND_H;
+}
+
+// Bins the recorded commands by band and rasterizes all bands
+void sw_rasterize() {
+    memset(sw.band_start, 0, (sw.band_cnt + 1) * sizeof(int));
+    int total = 0;
+    for (int i = 0; i < sw.cmd_cnt; i++) {
+        SwCmd* c = &sw.cmds[i];
+        int b0 = sw_band_of(c->y1 < c->y2 ? c->y1 : c->y2), b1 = sw_band_of(c->y1 < c->y2 ? c->y2 : c->y1);
+        for (int b = b0; b <= b1; b++) sw.band_start[b + 1]++;
+        total += b1 - b0 + 1;
+    }
+    if (total > sw.band_cmds_cap) {
+        int* cmds = realloc(sw.band_cmds, total * sizeof(int));
+        if (!cmds) return;
+        sw.band_cmds = cmds;
+        sw.band_cmds_cap = total;
+    }
+    for (int b = 0; b < sw.band_cnt; b++) sw.band_start[b + 1] += sw.band_start[b];
+    int* fill = sw.band_fill;
+    memcpy(fill, sw.band_start, sw.band_cnt * sizeof(int));
+    for (int i = 0; i < sw.cmd_cnt; i++) {
+        SwCmd* c = &sw.cmds[i];
+        int b0 = sw_band_of(c->y1 < c->y2 ? c->y1 : c->y2), b1 = sw_band_of(c->y1 < c->y2 ? c->y2 : c->y1);
+        for (int b = b0; b <= b1; b++) sw.band_cmds[fill[b]++] = i;
+    }
+    pool_run(&thread_pool, sw_raster_band, NULL, sw.band_cnt);
+}
+
+void gfx_color(Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+    if (draw_color.r != r || draw_color.g != g || draw_color.b != b || draw_color.a != a) PROF_COLOR_CHANGE();
+    draw_color = (SDL_Color){r, g, b, a};
+    if (render_path == RENDER_IMMEDIATE) SDL_SetRenderDrawColor(renderer, r, g, b, a);
+}
+
+void gfx_line(int x1, int y1, int x2, int y2) {
+    if (render_path == RENDER_IMMEDIATE) {
+        SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
+        PROF_DRAW_CALL();
+    } else if (render_path == RENDER_SOFTWARE) {
+        sw_line(x1, y1, x2, y2);
+    } else if (y1 == y2) {
+        int lo = x1 < x2 ? x1 : x2, hi = x1 < x2 ? x2 : x1;
+        batch_rect(lo, y1, hi - lo + 1, 1);
+    } else if (x1 == x2) {
+        int lo = y1 < y2 ? y1 : y2, hi = y1 < y2 ? y2 : y1;
+        batch_rect(x1, lo, 1, hi - lo + 1);
+    } else {
+        batch_segment(x1, y1, x2, y2, 0.5f);
+    }
+}
+
+void gfx_point(int x, int y) {
+    if (render_path == RENDER_IMMEDIATE) {
+        SDL_RenderDrawPoint(renderer, x, y);
+        PROF_DRAW_CALL();
+    } else if (render_path == RENDER_SOFTWARE) sw_rect(x, y, 1, 1);
+    else batch_rect(x, y, 1, 1);
+}
+
+void gfx_fill_rect(SDL_Rect r) {
+    if (render_path == RENDER_IMMEDIATE) {
+        SDL_RenderFillRect(renderer, &r);
+        PROF_DRAW_CALL();
+    } else if (r.w <= 0 || r.h <= 0) return;
+    else if (render_path == RENDER_SOFTWARE) sw_rect(r.x, r.y, r.w, r.h);
+    else batch_rect(r.x, r.y, r.w, r.h);
+}
+
+void gfx_rect(SDL_Rect r) {
+    if (render_path == RENDER_IMMEDIATE) {
+        SDL_RenderDrawRect(renderer, &r);
+        PROF_DRAW_CALL();
+        return;
+    }
+    if (r.w <= 0 || r.h <= 0) return;
+    gfx_fill_rect((SDL_Rect){r.x, r.y, r.w, 1});
+    gfx_fill_rect((SDL_Rect){r.x, r.y + r.h - 1, r.w, 1});
+    gfx_fill_rect((SDL_Rect){r.x, r.y + 1, 1, r.h - 2});
+    gfx_fill_rect((SDL_Rect){r.x + r.w - 1, r.y + 1, 1, r.h - 2});
+}
+
+void gfx_clear(Uint8 r, Uint8 g, Uint8 b) {
+    batch_quad_cnt = 0;
+    batch_submits = 0;
+    if (render_path == RENDER_SOFTWARE) {
+        sw_clear(r, g, b);
+        return;
+    }
+    SDL_SetRenderDrawColor(renderer, r, g, b, 255);
+    SDL_RenderClear(renderer);
+    PROF_DRAW_CALL();
+}
+
+// Gets everything drawn this frame onto the current render target
+void gfx_finish() {
+    if (render_path == RENDER_SOFTWARE) {
+        sw_rasterize();
+        SDL_UpdateTexture(sw.tex, NULL, sw.fb, sw.w * sizeof(Uint32));
+        SDL_RenderCopy(renderer, sw.tex, NULL, NULL);
+        PROF_DRAW_CALL();
+        return;
+    }
+    gfx_flush();
+}
+
+void set_render_path(int path) {
+    if (path == RENDER_SOFTWARE && !sw_init()) path = RENDER_BATCHED;
+    render_path = path;
+    printf("Render path: %s\n", render_path_names[render_path]);
+}
+
+void thick_line(int x1, int y1, int x2, int y2, int thickness) {
+    if (thickness <= 1) {
+        gfx_line(x1, y1, x2, y2);
+        return;
+    }
+    int dx = x2 - x1, dy = y2 - y1;
+    float len = hypotf(dx, dy);
+    if (len < 1.0f) return;
+    if (render_path == RENDER_BATCHED) {
+        batch_segment(x1, y1, x2, y2, thickness / 2 + 0.5f);
+        return;
+    }
+    float nx = -dy / len, ny = dx / len;
+    for (int t = -thickness/2; t <= thickness/2; t++) {
+        int ox = (int)(nx * t), oy = (int)(ny * t);
+        gfx_line(x1 + ox, y1 + oy, x2 + ox, y2 + oy);
+    }
+}
+
+const bool digit_segments[10][7] = {
+    {1,1,1,0,1,1,1}, // 0
+    {0,0,1,0,0,1,0}, // 1
+    {1,0,1,1,1,0,1}, // 2
+    {1,0,1,1,0,1,1}, // 3
+    {0,1,1,1,0,1,0}, // 4
+    {1,1,0,1,0,1,1}, // 5
+    {1,1,0,1,1,1,1}, // 6
+    {1,0,1,0,0,1,0}, // 7
+    {1,1,1,1,1,1,1}, // 8
+    {1,1,1,1,0,1,1}  // 9
+};
+
+#define DIGIT_W 20
+#define DIGIT_H 32
+#define DIGIT_THICK 4
+
+void draw_7segment_digit(int bx, int by, int digit) {
+    if (digit < 0 || digit > 9) return;
+    
+    int w = DIGIT_W;
+    int h = DIGIT_H;
+    int thick = DIGIT_THICK;
+    
+    if (digit_segments[digit][0]) thick_line(bx, by, bx + w, by, thick);
+    if (digit_segments[digit][1]) thick_line(bx, by, bx, by + h/2, thick);
+    if (digit_segments[digit][2]) thick_line(bx + w, by, bx + w, by + h/2, thick);
+    if (digit_segments[digit][3]) thick_line(bx, by + h/2, bx + w, by + h/2, thick);
+    if (digit_segments[digit][4]) thick_line(bx, by + h/2, bx, by + h, thick);
+    if (digit_segments[digit][5]) thick_line(bx + w, by + h/2, bx + w, by + h, thick);
+    if (digit_segments[digit][6]) thick_line(bx, by + h, bx + w, by + h, thick);
+}
+
+bool is_critical_overheat(const Ship* s) {
+    return s->heat >= OVERHEAT_MAX * OVERHEAT_CRITICAL_THRESHOLD;
+}
+
+bool is_overheat_warning(const Ship* s) {
+    return s->heat >= OVERHEAT_MAX * OVERHEAT_WARNING_THRESHOLD;
+}
+
+void spawn_cloud() {
+    if (world->clouds.count >= caps.max_clouds) return;
+    CloudInfo info;
+    info.size = 18 + (rng_int(RNG_GAMEPLAY, 32));
+    info.density = 0.65f + (rng_int(RNG_GAMEPLAY, 35)) / 100.0f;
+    info.phase = rng_float(RNG_GAMEPLAY) * 2 * M_PI - world->frame * CLOUD_PULSE_RATE;
+    info.pull_strength = 0.14f + (rng_int(RNG_GAMEPLAY, 70)) / 1000.0f;
+    info.value = 6 + (rng_int(RNG_GAMEPLAY, 10));
+    
+    Motion m;
+    int tries = 0;
+    do {
+        m.x = rng_int(RNG_GAMEPLAY, WORLD_W);
+        m.y = rng_int(RNG_GAMEPLAY, WORLD_H);
+    } while (distance_sq(m.x, m.y, world->ship.x, world->ship.y) < 180 * 180 && ++tries < 50);
+    int i = cloud_add(m.x, m.y);
+    
+    float dir = rng_float(RNG_GAMEPLAY) * 2 * M_PI;
+    float speed = 0.4f + (rng_int(RNG_GAMEPLAY, 50)) / 100.0f;
+    fast_sincos(dir, &m.vy, &m.vx);
+    m.vx *= speed;
+    m.vy *= speed;
+    world->clouds.motion[i] = m;
+    world->clouds.prev[i] = (SDL_FPoint){m.x, m.y};
+    
+    int hue = 140 + rng_int(RNG_GAMEPLAY, 100);
+    float sat = 0.9f + (rng_int(RNG_GAMEPLAY, 10))/100.0f;
+    float val = 1.0f;
+    float cmax = val * sat;
+    float hp = hue / 60.0f;
+    float x = cmax * (1 - fabsf(fast_wrap(hp, 2, 0.5f) - 1));
+    Uint8 r,g,b;
+    if (hp < 1) { r = cmax*255; g = x*255; b = 0; }
+    else if (hp < 2) { r = x*255; g = cmax*255; b = 0; }
+    else if (hp < 3) { r = 0; g = cmax*255; b = x*255; }
+    else if (hp < 4) { r = 0; g = x*255; b = cmax*255; }
+    else if (hp < 5) { r = x*255; g = 0; b = cmax*255; }
+    else { r = cmax*255; g = 0; b = x*255; }
+    info.color = (r << 16) | (g << 8) | b | 0xFF;
+    world->clouds.info[i] = info;
+}
+
+void spawn_creature() {
+    if (world->creatures.count >= caps.max_creatures) return;
+    CreatureInfo info;
+    CreatureSteer st;
+    Motion m;
+    info.size = 16 + rng_int(RNG_GAMEPLAY, 26);
+    info.hunt_phase = -world->frame * CREATURE_HUNT_RATE;
+    st.wiggle = rng_float(RNG_GAMEPLAY) * 2 * M_PI;
+    info.patrol_phase = rng_float(RNG_GAMEPLAY) * 2 * M_PI;
+    
+    st.type = rng_int(RNG_GAMEPLAY, 3);
+    
+    int tries = 0;
+    do {
+        float side = rng_int(RNG_GAMEPLAY, 4);
+        if (side == 0) { m.x = -100; m.y = rng_int(RNG_GAMEPLAY, WORLD_H); }
+        else if (side == 1) { m.x = WORLD_W + 100; m.y = rng_int(RNG_GAMEPLAY, WORLD_H); }
+        else if (side == 2) { m.y = -100; m.x = rng_int(RNG_GAMEPLAY, WORLD_W); }
+        else { m.y = WORLD_H + 100; m.x = rng_int(RNG_GAMEPLAY, WORLD_W); }
+    } while (tries++ < 80 && distance_sq(m.x, m.y, world->ship.x, world->ship.y) < 300 * 300);
+    int i = creature_add(m.x, m.y);
+    
+    float dir_to_ship = fast_atan2(world->ship.y - m.y, world->ship.x - m.x);
+    float offset = (rng_int(RNG_GAMEPLAY, 100) - 50) / 100.0f * M_PI / 2;
+    float target_dir = dir_to_ship + offset;
+    float target_dist = 300 + rng_int(RNG_GAMEPLAY, 400);
+    info.target_x = m.x + fast_cos(target_dir) * target_dist;
+    info.target_y = m.y + fast_sin(target_dir) * target_dist;
+    
+    float dir = rng_float(RNG_GAMEPLAY) * 2 * M_PI;
+    float base_speed = (st.type == 0) ? 0.8f : (st.type == 1) ? 1.4f : 1.0f;
+    fast_sincos(dir, &m.vy, &m.vx);
+    m.vx *= base_speed;
+    m.vy *= base_speed;
+    st.angle = dir;
+    
+    if (st.type == 0) info.color = 0x88BBFFFF | ((170 + rng_int(RNG_GAMEPLAY, 50)) << 24);
+    else if (st.type == 1) info.color = 0xFF8888FF | ((140 + rng_int(RNG_GAMEPLAY, 60)) << 24);
+    else info.color = 0xCC88FFFF | ((130 + rng_int(RNG_GAMEPLAY, 70)) << 24);
+    world->creatures.motion[i] = m;
+    world->creatures.steer[i] = st;
+    world->creatures.prev[i] = (Pose){m.x, m.y, st.angle};
+    world->creatures.info[i] = info;
+}
+
+void spawn_nebula(int idx) {
+    Nebula* n = &world->nebulas[idx];
+    n->active = true;
+    n->radius = 180 + rng_int(RNG_FX, 120);
+    n->density = 0.4f + (rng_int(RNG_FX, 40))/100.0f;
+    n->swirl = rng_float(RNG_FX) * 2 * M_PI;
+    n->pulse = 0.0f;
+    n->x = WORLD_W * (0.2f + (rng_int(RNG_FX, 1000))/10000.0f * 0.6f) - world->scrollX * 0.07f;
+    n->y = 100 + rng_int(RNG_FX, 400);
+    
+    // Dark, starry blue/indigo — subtle, atmospheric, non-distracting
+    int hue = 220 + rng_int(RNG_FX, 40);              // Deep blue to indigo
+    float sat = 0.35f + (rng_int(RNG_FX, 15))/100.0f; // Low saturation
+    float val = 0.45f + (rng_int(RNG_FX, 15))/100.0f; // Dark value
+    float cmax = val * sat;
+    float hp = hue / 60.0f;
+    float x = cmax * (1 - fabsf(fast_wrap(hp, 2, 0.5f) - 1));
+    Uint8 r,g,b;
+    if (hp < 1) { r = cmax*255; g = x*255; b = 0; }
+    else if (hp < 2) { r = x*255; g = cmax*255; b = 0; }
+    else if (hp < 3) { r = 0; g = cmax*255; b = x*255; }
+    else if (hp < 4) { r = 0; g = x*255; b = cmax*255; }
+    else if (hp < 5) { r = x*255; g = 0; b = cmax*255; }
+    else { r = cmax*255; g = 0; b = x*255; }
+    n->color = (r << 16) | (g << 8) | b | 0x88; // Subtle transparency
+}
+
+// Scales a population target tuned for the default capacities to the
+// configured ones, so a 10x config actually runs 10x the entities
+int scaled_population(int n, int capacity, int default_capacity) {
+    return (int)((long long)n * capacity / default_capacity);
+}
+
+// Resets all pooled entity state in one go: the whole arena is zeroed and the
+// counters and grids are put back into their empty state.
+void world_reset() {
+    memset(world->state, 0, world->state_size);
+    world->clouds.count = world->creatures.count = world->nebula_cnt = 0;
+    entity_ids_reset(&world->clouds.ids, world->clouds.capacity);
+    entity_ids_reset(&world->creatures.ids, world->creatures.capacity);
+    world->particles.count = 0;
+    memset(world->particles.live, 0, sizeof(world->particles.live));
+    grid_clear(&world->cloud_grid);
+    grid_clear(&world->creature_grid);
+}
+
+void init_game() {
+    world->ship = (Ship){
+        WORLD_W / 2.0f, WORLD_H / 2.0f, 0, 0, -M_PI / 2,
+        1000.0f, 0, 0, 0, 3, false, 0, false, 0,
+        0.0f,
+        WORLD_W / 2.0f, WORLD_H / 2.0f, -M_PI / 2
+    };
+    world_reset();
+    world->frame = 0;
+    world->scrollX = 0.0f;
+    world->prev_scrollX = 0.0f;
+    world->danger_level = 0.0f;
+    world->wave = 1;
+    world->clouds_collected_this_wave = 0;
+    world->clouds_needed_for_next_wave = CLOUDS_PER_WAVE_BASE;
+    world->wave_flash_timer = 0;
+    world->current_wave_display_timer = 0;
+    
+    for (int i = 0; i < scaled_population(35, caps.max_clouds, MAX_CLOUDS); i++) spawn_cloud();
+    for (int i = 0; i < MAX_NEBULAE; i++) spawn_nebula(i);
+    
+    world->starfield_seed = rng_next(RNG_FX);
+    
+    for (int i = 0; i < NUM_PLANETS; i++) {
+        world->planets[i].base_x = 800 + (rng_int(RNG_FX, 1200));
+        world->planets[i].base_y = 100 + rng_int(RNG_FX, 400);
+        world->planets[i].radius = 28 + rng_int(RNG_FX, 28);
+        world->planets[i].color = (rng_int(RNG_FX, 128) + 64) << 16 | (rng_int(RNG_FX, 128) + 64) << 8 | (rng_int(RNG_FX, 255));
+        world->planets[i].spin = 0;
+    }
+    
+    world->sun.base_x = WORLD_W * 0.7f;
+    world->sun.base_y = WORLD_H * 0.25f;
+    world->sun.radius = 110;
+    world->sun.pulse_phase = 0;
+    
+    for (int i = 0; i < scaled_population(8, caps.max_creatures, MAX_CREATURES); i++) spawn_creature();
+}
+
+// Input is sampled once per tick as a bitmask from the active input source:
+// the keyboard when windowed, or a script / autopilot when running headless.
+#define INPUT_LEFT    0x01
+#define INPUT_RIGHT   0x02
+#define INPUT_THRUST  0x04
+#define INPUT_TRACTOR 0x08
+
+#define MAX_SCRIPT_STEPS 1024
+
+typedef struct {
+    int ticks;
+    Uint8 input;
+} ScriptStep;
+
+ScriptStep script_steps[MAX_SCRIPT_STEPS];
+int script_step_cnt = 0;
+int script_pos = 0;
+int script_tick = 0;
+
+// The keyboard is sampled on the main thread after event polling; the
+// simulation, which may run on its own thread, only reads the sampled bits.
+SDL_atomic_t keyboard_bits;
+
+void keyboard_sample() {
+    const Uint8* keys = SDL_GetKeyboardState(NULL);
+    Uint8 in = 0;
+    if (keys[SDL_SCANCODE_A] || keys[SDL_SCANCODE_LEFT]) in |= INPUT_LEFT;
+    if (keys[SDL_SCANCODE_D] || keys[SDL_SCANCODE_RIGHT]) in |= INPUT_RIGHT;
+    if (keys[SDL_SCANCODE_W] || keys[SDL_SCANCODE_UP]) in |= INPUT_THRUST;
+    if (keys[SDL_SCANCODE_SPACE]) in |= INPUT_TRACTOR;
+    SDL_AtomicSet(&keyboard_bits, in);
+}
+
+Uint8 keyboard_input() {
+    return (Uint8)SDL_AtomicGet(&keyboard_bits);
+}
+
+// Synthetic pilot: chase the nearest cloud with the tractor on, veer away from
+// close creatures and let the engine cool before it overheats.
+Uint8 autopilot_input() {
+    float best = 1e9f, tx = world->ship.x, ty = world->ship.y;
+    for (int i = 0; i < world->clouds.count; i++) {
+        const Motion* m = &world->clouds.motion[i];
+        float d = distance(m->x, m->y, world->ship.x, world->ship.y);
+        if (d < best) { best = d; tx = m->x; ty = m->y; }
+    }
+    float dx = tx - world->ship.x, dy = ty - world->ship.y;
+    if (fabsf(dx) > WORLD_W / 2) dx -= (dx > 0 ? WORLD_W : -WORLD_W);
+    if (fabsf(dy) > WORLD_H / 2) dy -= (dy > 0 ? WORLD_H : -WORLD_H);
+    
+    for (int i = 0; i < world->creatures.count; i++) {
+        float cdx = world->creatures.motion[i].x - world->ship.x, cdy = world->creatures.motion[i].y - world->ship.y;
+        if (fabsf(cdx) > WORLD_W / 2) cdx -= (cdx > 0 ? WORLD_W : -WORLD_W);
+        if (fabsf(cdy) > WORLD_H / 2) cdy -= (cdy > 0 ? WORLD_H : -WORLD_H);
+        float d = fast_hypot(cdx, cdy);
+        if (d < 220.0f && d > 0) {
+            dx -= cdx / d * 400.0f;
+            dy -= cdy / d * 400.0f;
+        }
+    }
+    
+    float diff = fast_atan2(dy, dx) - world->ship.angle;
+    diff = fast_wrap(diff + 3 * (float)M_PI, 2 * (float)M_PI, 1 / (2 * (float)M_PI)) - (float)M_PI;
+    Uint8 in = 0;
+    if (diff < -0.1f) in |= INPUT_LEFT;
+    if (diff > 0.1f) in |= INPUT_RIGHT;
+    if (fabsf(diff) < 0.6f && !is_overheat_warning(&world->ship)) in |= INPUT_THRUST;
+    if (best < TRACTOR_RANGE) in |= INPUT_TRACTOR;
+    return in;
+}
+
+// Script file: one "<ticks> <keys>" step per line, keys from L R T B (beam)
+// or "-" for none. The script loops when it runs out.
+bool load_input_script(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    char keys[16];
+    int ticks;
+    script_step_cnt = 0;
+    while (script_step_cnt < MAX_SCRIPT_STEPS && fscanf(f, "%d %15s", &ticks, keys) == 2) {
+        Uint8 in = 0;
+        for (char* k = keys; *k; k++) {
+            if (*k == 'L') in |= INPUT_LEFT;
+            else if (*k == 'R') in |= INPUT_RIGHT;
+            else if (*k == 'T') in |= INPUT_THRUST;
+            else if (*k == 'B') in |= INPUT_TRACTOR;
+        }
+        if (ticks > 0) script_steps[script_step_cnt++] = (ScriptStep){ticks, in};
+    }
+    fclose(f);
+    script_pos = script_tick = 0;
+    return script_step_cnt > 0;
+}
+
+Uint8 script_input() {
+    if (script_step_cnt == 0) return 0;
+    Uint8 in = script_steps[script_pos].input;
+    if (++script_tick >= script_steps[script_pos].ticks) {
+        script_tick = 0;
+        script_pos = (script_pos + 1) % script_step_cnt;
+    }
+    return in;
+}
+
+
+// FNV-1a over the simulation state, for checking that runs are bit-identical
+Uint64 hash_bytes(Uint64 h, const void* data, size_t n) {
+    const Uint8* p = data;
+    for (size_t i = 0; i < n; i++) h = (h ^ p[i]) * 0x100000001B3ull;
+    return h;
+}
+
+Uint64 world_hash() {
+    Uint64 h = 0xCBF29CE484222325ull;
+    float ship_state[] = {world->ship.x, world->ship.y, world->ship.vx, world->ship.vy, world->ship.angle, world->ship.fuel, world->ship.heat};
+    int counters[] = {world->ship.score, world->ship.lives, world->ship.combo, world->wave, world->frame, world->clouds.count, world->creatures.count, world->particles.count};
+    h = hash_bytes(h, ship_state, sizeof(ship_state));
+    h = hash_bytes(h, counters, sizeof(counters));
+    h = hash_bytes(h, world->clouds.motion, world->clouds.count * sizeof(Motion));
+    h = hash_bytes(h, world->creatures.motion, world->creatures.count * sizeof(Motion));
+    float* fields[] = {world->particles.x, world->particles.y, world->particles.vx, world->particles.vy, world->particles.life};
+    for (int i = 0; i < (int)SDL_arraysize(fields); i++) h = hash_bytes(h, fields[i], world->particles.count * sizeof(float));
+    return h;
+}
+
+// Input recordings (--record FILE, --replay FILE). A recording holds the
+// seed and capacities the session started with, then the input of every
+// tick as runs of identical bitmasks, plus the state hash every
+// REPLAY_CHECKPOINT ticks so a replay can tell when it diverges. All numbers
+// are LEB128 varints:
+//   "NHRP" version  seed  max_clouds max_creatures max_particles stars debris
+//   then records:  0x00-0x0F run     input bits, ticks
+//                  0x10      hash    ticks since the previous hash, 8 bytes LE
+//                  0x11      end     total ticks
+#define REPLAY_VERSION 1
+#define REPLAY_CHECKPOINT 600
+enum { REC_HASH = 0x10, REC_END = 0x11 };
+
+typedef struct {
+    Uint8 input;
+    Uint32 ticks;
+} InputRun;
+
+typedef struct {
+    Uint32 tick;
+    Uint64 hash;
+} Checkpoint;
+
+// Only the thread running update() touches these
+typedef struct {
+    FILE* file;
+    Uint8 input;
+    Uint32 run;            // ticks in the current run
+    Uint32 ticks, last_checkpoint;
+} Recorder;
+
+typedef struct {
+    Uint64 seed;
+    Capacities caps;
+    InputRun* runs;
+    int run_cnt;
+    Checkpoint* checkpoints;
+    int checkpoint_cnt;
+    Uint32 total_ticks;
+    int run_pos;
+    Uint32 run_tick, tick;
+    int next_checkpoint, verified, diverged;
+    Uint32 first_divergence;
+    SDL_atomic_t done;     // read by the main loop
+} Replay;
+
+Recorder recorder;
+Replay replay;
+
+Uint8* write_varint(Uint8* p, Uint64 v) {
+    while (v >= 0x80) {
+        *p++ = (Uint8)(v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    *p++ = (Uint8)v;
+    return p;
+}
+
+void put_varint(FILE* f, Uint64 v) {
+    while (v >= 0x80) {
+        fputc((int)(v & 0x7F) | 0x80, f);
+        v >>= 7;
+    }
+    fputc((int)v, f);
+}
+
+bool get_varint(const Uint8** p, const Uint8* end, Uint64* v) {
+    *v = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7) {
+        Uint8 b = *(*p)++;
+        *v |= (Uint64)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+bool recorder_open(const char* path, Uint64 seed) {
+    recorder = (Recorder){.file = fopen(path, "wb")};
+    if (!recorder.file) return false;
+    fwrite("NHRP", 1, 4, recorder.file);
+    put_varint(recorder.file, REPLAY_VERSION);
+    put_varint(recorder.file, seed);
+    int c[] = {caps.max_clouds, caps.max_creatures, caps.max_particles, caps.stars_per_screen, caps.debris_per_screen};
+    for (int i = 0; i < (int)SDL_arraysize(c); i++) put_varint(recorder.file, c[i]);
+    return true;
+}
+
+void recorder_flush_run() {
+    if (!recorder.run) return;
+    fputc(recorder.input, recorder.file);
+    put_varint(recorder.file, recorder.run);
+    recorder.run = 0;
+}
+
+void record_input(Uint8 input) {
+    if (input != recorder.input) recorder_flush_run();
+    recorder.input = input;
+    recorder.run++;
+}
+
+void recorder_checkpoint() {
+    Uint64 h = world_hash();
+    fputc(REC_HASH, recorder.file);
+    put_varint(recorder.file, recorder.ticks - recorder.last_checkpoint);
+    for (int i = 0; i < 8; i++) fputc((int)(h >> (8 * i)) & 0xFF, recorder.file);
+    recorder.last_checkpoint = recorder.ticks;
+}
+
+// Ends the file with a final hash, so a replay checks the whole session
+void recorder_close() {
+    if (!recorder.file) return;
+    recorder_flush_run();
+    if (recorder.ticks != recorder.last_checkpoint) recorder_checkpoint();
+    fputc(REC_END, recorder.file);
+    put_varint(recorder.file, recorder.ticks);
+    long size = ftell(recorder.file);
+    fclose(recorder.file);
+    recorder.file = NULL;
+    printf("Recorded %u ticks in %ld bytes\n", recorder.ticks, size);
+}
+
+bool replay_load(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    Uint8* data = size > 4 ? malloc(size) : NULL;
+    bool ok = data && fread(data, 1, size, f) == (size_t)size && memcmp(data, "NHRP", 4) == 0;
+    fclose(f);
+    if (!ok) {
+        free(data);
+        return false;
+    }
+    
+    const Uint8* p = data + 4;
+    const Uint8* end = data + size;
+    Uint64 header[7];
+    for (int i = 0; ok && i < 7; i++) ok = get_varint(&p, end, &header[i]);
+    ok = ok && header[0] == REPLAY_VERSION;
+    if (ok) {
+        replay.seed = header[1];
+        for (int i = 0; i < 5; i++) ok &= header[2 + i] <= MAX_CAPACITY;
+        replay.caps = (Capacities){(int)header[2], (int)header[3], (int)header[4], (int)header[5], (int)header[6]};
+    }
+    
+    int run_cap = 0, checkpoint_cap = 0;
+    Uint32 tick = 0, checkpoint_tick = 0;
+    bool ended = false;
+    // A session that was killed leaves a cut-off last record and no end
+    // record; it still replays as far as it got
+    while (ok && !ended && p < end) {
+        Uint8 tag = *p++;
+        Uint64 v;
+        if (!get_varint(&p, end, &v)) break;
+        if (tag < REC_HASH) {
+            if (replay.run_cnt == run_cap) {
+                run_cap = run_cap ? run_cap * 2 : 256;
+                InputRun* grown = realloc(replay.runs, run_cap * sizeof(InputRun));
+                if (!grown) { ok = false; break; }
+                replay.runs = grown;
+            }
+            replay.runs[replay.run_cnt++] = (InputRun){tag, (Uint32)v};
+            tick += (Uint32)v;
+        } else if (tag == REC_HASH) {
+            if (end - p < 8) break;
+            if (replay.checkpoint_cnt == checkpoint_cap) {
+                checkpoint_cap = checkpoint_cap ? checkpoint_cap * 2 : 64;
+                Checkpoint* grown = realloc(replay.checkpoints, checkpoint_cap * sizeof(Checkpoint));
+                if (!grown) { ok = false; break; }
+                replay.checkpoints = grown;
+            }
+            checkpoint_tick += (Uint32)v;
+            Uint64 h = 0;
+            for (int i = 0; i < 8; i++) h |= (Uint64)*p++ << (8 * i);
+            replay.checkpoints[replay.checkpoint_cnt++] = (Checkpoint){checkpoint_tick, h};
+        } else if (tag == REC_END) {
+            ended = v == tick;
+            ok = ended;
+        } else ok = false;
+    }
+    free(data);
+    replay.total_ticks = tick;
+    if (!ok) {
+        free(replay.runs);
+        free(replay.checkpoints);
+        replay = (Replay){0};
+        return false;
+    }
+    if (!ended) fprintf(stderr, "%s has no end record, replaying the %u ticks it has\n", path, tick);
+    return true;
+}
+
+Uint8 replay_input() {
+    if (replay.run_pos >= replay.run_cnt) return 0;
+    Uint8 in = replay.runs[replay.run_pos].input;
+    if (++replay.run_tick >= replay.runs[replay.run_pos].ticks) {
+        replay.run_tick = 0;
+        replay.run_pos++;
+    }
+    return in;
+}
+
+void replay_report() {
+    printf("Replay: %u of %u ticks, %d of %d checkpoints verified", replay.tick, replay.total_ticks,
+           replay.verified, replay.checkpoint_cnt);
+    if (replay.diverged) printf(", %d DIVERGED (first at tick %u)", replay.diverged, replay.first_divergence);
+    printf("\n");
+}
+
+// Called at the end of every tick
+void input_log_tick() {
+    if (recorder.file) {
+        recorder.ticks++;
+        if (recorder.ticks - recorder.last_checkpoint >= REPLAY_CHECKPOINT) recorder_checkpoint();
+    }
+    if (world->input_source != replay_input || SDL_AtomicGet(&replay.done)) return;
+    replay.tick++;
+    if (replay.next_checkpoint < replay.checkpoint_cnt && replay.checkpoints[replay.next_checkpoint].tick == replay.tick) {
+        if (world_hash() == replay.checkpoints[replay.next_checkpoint].hash) replay.verified++;
+        else if (!replay.diverged++) {
+            replay.first_divergence = replay.tick;
+            fprintf(stderr, "Replay diverged from the recording at tick %u\n", replay.tick);
+        }
+        replay.next_checkpoint++;
+    }
+    if (replay.tick == replay.total_ticks) {
+        replay_report();
+        SDL_AtomicSet(&replay.done, 1);
+    }
+}
+
+void store_prev_state() {
+    world->ship.prev_x = world->ship.x;
+    world->ship.prev_y = world->ship.y;
+    world->ship.prev_angle = world->ship.angle;
+    world->prev_scrollX = world->scrollX;
+    for (int i = 0; i < world->clouds.count; i++) world->clouds.prev[i] = (SDL_FPoint){world->clouds.motion[i].x, world->clouds.motion[i].y};
+    for (int i = 0; i < world->creatures.count; i++)
+        world->creatures.prev[i] = (Pose){world->creatures.motion[i].x, world->creatures.motion[i].y, world->creatures.steer[i].angle};
+    memcpy(world->particles.prev_x, world->particles.x, world->particles.count * sizeof(float));
+    memcpy(world->particles.prev_y, world->particles.y, world->particles.count * sizeof(float));
+}
+
+// Rollback ring: the complete simulation state after each of the last
+// ROLLBACK_TICKS ticks, so a rollback netcode layer can rewind K ticks and
+// resimulate them with corrected input. A saved state is flat and
+// pointer-free: the world's scalars in SimScalars, then the block of arena
+// memory its pools live in, which never moves. States go into one
+// preallocated byte ring, either raw, so saving and restoring are two
+// memcpys each, or with --rollback-delta every ROLLBACK_KEY_INTERVAL-th raw
+// and the others as their XOR against that keyframe, with the runs of zero
+// words left out. Deltas shrink to a few KB in quiet scenes but approach a
+// full state when the particle pool churns, so the delta ring is sized to
+// still hold ROLLBACK_TICKS at worst, and holds up to ROLLBACK_SLOTS when it
+// can.
+#define ROLLBACK_TICKS 16
+#define ROLLBACK_SLOTS 64
+#define ROLLBACK_KEY_INTERVAL 8
+
+typedef struct {
+    Ship ship;
+    Nebula nebulas[MAX_NEBULAE];
+    Planet planets[NUM_PLANETS];
+    Sun sun;
+    Rng rng[RNG_STREAM_COUNT];
+    int cloud_cnt, creature_cnt, cloud_free, creature_free, nebula_cnt, frame;
+    float scrollX, prev_scrollX, danger_level;
+    int combo_timer, wave, clouds_collected_this_wave, clouds_needed_for_next_wave;
+    int wave_flash_timer, current_wave_display_timer;
+    Uint32 starfield_seed;
+    int particle_count, particle_live[EMITTER_COUNT];
+    bool prev_tractor;
+} SimScalars;
+
+typedef struct {
+    Uint32 tick;     // counts saves
+    size_t offset, size;
+    bool key;
+} RollbackSlot;
+
+typedef struct {
+    Arena mem;
+    Uint8* ring;
+    size_t ring_size, head;
+    Uint8* key_state;      // raw copy of the newest keyframe (delta mode)
+    Uint8* scratch;        // a state being encoded or decoded (delta mode)
+    size_t scalars_size, state_size;
+    bool delta;
+    RollbackSlot slots[ROLLBACK_SLOTS];   // oldest first, from `first`
+    int first, count;
+    Uint32 tick;
+    bool resimulating;
+    const Uint8* inputs;   // fed to update() while advancing
+    Uint64 deltas, delta_bytes;
+} Rollback;
+
+Rollback rollback;
+bool use_rollback_delta = false;
+
+// A delta never takes more than the state plus its run headers
+size_t rollback_max_record() {
+    return rollback.delta ? rollback.state_size + 64 : rollback.state_size;
+}
+
+bool rollback_init(bool delta) {
+    rollback = (Rollback){.delta = delta};
+    rollback.scalars_size = (sizeof(SimScalars) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    rollback.state_size = rollback.scalars_size + ((world->state_size + 7) & ~(size_t)7);
+    // Eviction in delta mode can waste up to two records of space plus a
+    // keyframe's worth of deltas that go with it
+    rollback.ring_size = delta ? (ROLLBACK_TICKS + ROLLBACK_KEY_INTERVAL + 2) * rollback_max_record()
+                               : ROLLBACK_TICKS * rollback.state_size;
+    Arena measure = {0};
+    for (int pass = 0; pass < 2; pass++) {
+        Arena* a = pass ? &rollback.mem : &measure;
+        rollback.ring = arena_alloc(a, rollback.ring_size);
+        if (delta) {
+            rollback.key_state = arena_alloc(a, rollback.state_size);
+            rollback.scratch = arena_alloc(a, rollback.state_size);
+        }
+        if (!pass && !arena_create(&rollback.mem, measure.used)) return false;
+    }
+    return true;
+}
+
+void rollback_store(Uint8* dst) {
+    SimScalars* s = (SimScalars*)dst;
+    s->ship = world->ship;
+    memcpy(s->nebulas, world->nebulas, sizeof(world->nebulas));
+    memcpy(s->planets, world->planets, sizeof(world->planets));
+    s->sun = world->sun;
+    memcpy(s->rng, world->rng_streams, sizeof(world->rng_streams));
+    s->cloud_cnt = world->clouds.count;
+    s->creature_cnt = world->creatures.count;
+    s->cloud_free = world->clouds.ids.free_cnt;
+    s->creature_free = world->creatures.ids.free_cnt;
+    s->nebula_cnt = world->nebula_cnt;
+    s->frame = world->frame;
+    s->scrollX = world->scrollX;
+    s->prev_scrollX = world->prev_scrollX;
+    s->danger_level = world->danger_level;
+    s->combo_timer = world->combo_timer;
+    s->wave = world->wave;
+    s->clouds_collected_this_wave = world->clouds_collected_this_wave;
+    s->clouds_needed_for_next_wave = world->clouds_needed_for_next_wave;
+    s->wave_flash_timer = world->wave_flash_timer;
+    s->current_wave_display_timer = world->current_wave_display_timer;
+    s->starfield_seed = world->starfield_seed;
+    s->particle_count = world->particles.count;
+    memcpy(s->particle_live, world->particles.live, sizeof(world->particles.live));
+    s->prev_tractor = world->prev_tractor;
+    memcpy(dst + rollback.scalars_size, world->state, world->state_size);
+}
+
+void rollback_load(const Uint8* src) {
+    const SimScalars* s = (const SimScalars*)src;
+    world->ship = s->ship;
+    memcpy(world->nebulas, s->nebulas, sizeof(world->nebulas));
+    memcpy(world->planets, s->planets, sizeof(world->planets));
+    world->sun = s->sun;
+    memcpy(world->rng_streams, s->rng, sizeof(world->rng_streams));
+    world->clouds.count = s->cloud_cnt;
+    world->creatures.count = s->creature_cnt;
+    world->clouds.ids.free_cnt = s->cloud_free;
+    world->creatures.ids.free_cnt = s->creature_free;
+    world->nebula_cnt = s->nebula_cnt;
+    world->frame = s->frame;
+    world->scrollX = s->scrollX;
+    world->prev_scrollX = s->prev_scrollX;
+    world->danger_level = s->danger_level;
+    world->combo_timer = s->combo_timer;
+    world->wave = s->wave;
+    world->clouds_collected_this_wave = s->clouds_collected_this_wave;
+    world->clouds_needed_for_next_wave = s->clouds_needed_for_next_wave;
+    world->wave_flash_timer = s->wave_flash_timer;
+    world->current_wave_display_timer = s->current_wave_display_timer;
+    world->starfield_seed = s->starfield_seed;
+    world->particles.count = s->particle_count;
+    memcpy(world->particles.live, s->particle_live, sizeof(world->particles.live));
+    world->prev_tractor = s->prev_tractor;
+    memcpy(world->state, src + rollback.scalars_size, world->state_size);
+}
+
+// Delta records are a sequence of (zero words, literal words, the literal
+// words) over the XOR of the two states, in 64-bit words
+size_t rollback_encode(const Uint8* state, const Uint8* key, Uint8* out) {
+    const Uint64* a = (const Uint64*)state;
+    const Uint64* b = (const Uint64*)key;
+    size_t n = rollback.state_size / 8, i = 0;
+    Uint8* p = out;
+    while (i < n) {
+        size_t zeros = i;
+        while (i < n && a[i] == b[i]) i++;
+        zeros = i - zeros;
+        size_t lit = i;
+        while (i < n && a[i] != b[i]) i++;
+        lit = i - lit;
+        p = write_varint(p, zeros);
+        p = write_varint(p, lit);
+        for (size_t k = i - lit; k < i; k++) {
+            Uint64 x = a[k] ^ b[k];
+            memcpy(p, &x, 8);
+            p += 8;
+        }
+    }
+    return p - out;
+}
+
+void rollback_apply(Uint8* state, const Uint8* delta, size_t size) {
+    Uint64* a = (Uint64*)state;
+    const Uint8* p = delta;
+    const Uint8* end = delta + size;
+    size_t i = 0;
+    while (p < end) {
+        Uint64 zeros, lit;
+        get_varint(&p, end, &zeros);
+        get_varint(&p, end, &lit);
+        i += zeros;
+        for (Uint64 k = 0; k < lit; k++, i++) {
+            Uint64 x;
+            memcpy(&x, p, 8);
+            p += 8;
+            a[i] ^= x;
+        }
+    }
+}
+
+void rollback_drop_oldest() {
+    rollback.first = (rollback.first + 1) % ROLLBACK_SLOTS;
+    rollback.count--;
+}
+
+RollbackSlot* rollback_slot(int age) {
+    return &rollback.slots[(rollback.first + rollback.count - 1 - age) % ROLLBACK_SLOTS];
+}
+
+// Saves the current state as the newest entry
+void rollback_save() {
+    Rollback* r = &rollback;
+    bool key = !r->delta || r->tick % ROLLBACK_KEY_INTERVAL == 0;
+    size_t reserve = key ? r->state_size : rollback_max_record();
+    if (r->head + reserve > r->ring_size) r->head = 0;
+    for (;;) {
+        bool overlap = false;
+        for (int k = 0; k < r->count && !overlap; k++) {
+            RollbackSlot* s = rollback_slot(k);
+            overlap = s->offset < r->head + reserve && s->offset + s->size > r->head;
+        }
+        if (!overlap && r->count < ROLLBACK_SLOTS) break;
+        rollback_drop_oldest();
+    }
+    
+    Uint8* dst = r->ring + r->head;
+    size_t size = r->state_size;
+    if (key) {
+        rollback_store(dst);
+        if (r->delta) memcpy(r->key_state, dst, r->state_size);
+    } else {
+        rollback_store(r->scratch);
+        size = rollback_encode(r->scratch, r->key_state, dst);
+        r->deltas++;
+        r->delta_bytes += size;
+    }
+    r->slots[(r->first + r->count++) % ROLLBACK_SLOTS] = (RollbackSlot){r->tick++, r->head, size, key};
+    r->head += size;
+    // A delta is useless once its keyframe is gone
+    while (r->count > 0 && !r->slots[r->first].key) rollback_drop_oldest();
+}
+
+// Ticks that can be rolled back, counting from the newest save
+int rollback_depth() {
+    return rollback.count - 1;
+}
+
+// Puts the world back to where it was `age` saves ago (0 = the newest) and
+// forgets every save after it. Returns false if that is no longer held.
+bool rollback_restore(int age) {
+    Rollback* r = &rollback;
+    if (age < 0 || age >= r->count) return false;
+    RollbackSlot* s = rollback_slot(age);
+    if (s->key) {
+        rollback_load(r->ring + s->offset);
+    } else {
+        RollbackSlot* key = s;
+        for (int k = age + 1; !key->key; k++) key = rollback_slot(k);
+        memcpy(r->scratch, r->ring + key->offset, r->state_size);
+        rollback_apply(r->scratch, r->ring + s->offset, s->size);
+        rollback_load(r->scratch);
+    }
+    if (r->delta && age > 0) {
+        // Later keyframes are discarded along with their deltas
+        RollbackSlot* key = s;
+        for (int k = age + 1; !key->key; k++) key = rollback_slot(k);
+        memcpy(r->key_state, r->ring + key->offset, r->state_size);
+    }
+    r->count -= age;
+    r->tick = s->tick + 1;
+    r->head = s->offset + s->size;
+    return true;
+}
+
+// Snapshot handoff between the simulation and the renderer. Three snapshots
+// rotate between the writer, the reader and a spare slot held in an atomic,
+// so neither side ever waits: publishing swaps the freshly written snapshot
+// into the spare slot, and acquiring swaps the spare out only when it holds
+// a newer tick than the one being drawn.
+#define SNAPSHOT_FRESH 4
+
+Snapshot snapshots[3];
+SDL_atomic_t snapshot_spare;
+int snapshot_write = 0;
+int snapshot_read = 1;
+
+void snapshot_init(Snapshot* snap, Arena* a) {
+    cloud_store_init(&snap->clouds, a, caps.max_clouds);
+    creature_store_init(&snap->creatures, a, caps.max_creatures);
+    int cap = caps.max_particles;
+    snap->particles = (ParticlePool){.capacity = cap};
+    snap->particles.x = arena_alloc(a, cap * sizeof(float));
+    snap->particles.y = arena_alloc(a, cap * sizeof(float));
+    snap->particles.prev_x = arena_alloc(a, cap * sizeof(float));
+    snap->particles.prev_y = arena_alloc(a, cap * sizeof(float));
+    snap->particles.life = arena_alloc(a, cap * sizeof(float));
+    snap->particles.color = arena_alloc(a, cap * sizeof(Uint32));
+}
+
+void snapshot_fill(Snapshot* snap) {
+    snap->ship = world->ship;
+    snap->frame = world->frame;
+    snap->scrollX = world->scrollX;
+    snap->prev_scrollX = world->prev_scrollX;
+    snap->wave = world->wave;
+    snap->current_wave_display_timer = world->current_wave_display_timer;
+    snap->sun = world->sun;
+    memcpy(snap->nebulas, world->nebulas, sizeof(world->nebulas));
+    memcpy(snap->planets, world->planets, sizeof(world->planets));
+    CloudStore* cs = &snap->clouds;
+    cs->count = world->clouds.count;
+    memcpy(cs->motion, world->clouds.motion, world->clouds.count * sizeof(Motion));
+    memcpy(cs->prev, world->clouds.prev, world->clouds.count * sizeof(SDL_FPoint));
+    memcpy(cs->info, world->clouds.info, world->clouds.count * sizeof(CloudInfo));
+    CreatureStore* ns = &snap->creatures;
+    ns->count = world->creatures.count;
+    memcpy(ns->motion, world->creatures.motion, world->creatures.count * sizeof(Motion));
+    memcpy(ns->steer, world->creatures.steer, world->creatures.count * sizeof(CreatureSteer));
+    memcpy(ns->prev, world->creatures.prev, world->creatures.count * sizeof(Pose));
+    memcpy(ns->info, world->creatures.info, world->creatures.count * sizeof(CreatureInfo));
+    snap->starfield_seed = world->starfield_seed;
+    ParticlePool* pp = &snap->particles;
+    pp->count = world->particles.count;
+    memcpy(pp->live, world->particles.live, sizeof(pp->live));
+    memcpy(pp->x, world->particles.x, world->particles.count * sizeof(float));
+    memcpy(pp->y, world->particles.y, world->particles.count * sizeof(float));
+    memcpy(pp->prev_x, world->particles.prev_x, world->particles.count * sizeof(float));
+    memcpy(pp->prev_y, world->particles.prev_y, world->particles.count * sizeof(float));
+    memcpy(pp->life, world->particles.life, world->particles.count * sizeof(float));
+    memcpy(pp->color, world->particles.color, world->particles.count * sizeof(Uint32));
+}
+
+// Simulation side: copies the current state out and hands it over
+void snapshot_publish() {
+    PROF_BEGIN(PROF_SNAPSHOT);
+    snapshot_fill(&snapshots[snapshot_write]);
+    snapshot_write = SDL_AtomicSet(&snapshot_spare, snapshot_write | SNAPSHOT_FRESH) & 3;
+    PROF_END(PROF_SNAPSHOT);
+}
+
+// Render side: points `view` at the newest published snapshot
+void snapshot_acquire() {
+    if (SDL_AtomicGet(&snapshot_spare) & SNAPSHOT_FRESH) {
+        snapshot_read = SDL_AtomicSet(&snapshot_spare, snapshot_read) & 3;
+    }
+    view = &snapshots[snapshot_read];
+}
+
+// Parallel simulation passes. Clouds, creatures and particles are advanced
+// in fixed-size chunks on sim_pool. A chunk writes only its own entities and
+// queues its grid cell changes, which are relinked in chunk order once the
+// pass is done. Everything that touches shared state (RNG draws, harvests,
+// hits, score, particle spawns) stays on the calling thread and runs in index
+// order, so the outcome is bit-identical for any thread count.
+#define SIM_CHUNK 256
+#define PARTICLE_CHUNK 4096   // a multiple of 8, so chunks split on SIMD vectors
+
+ThreadPool sim_pool;
+int sim_threads = -1;   // -1 = one per core beyond the calling thread
+
+int chunk_count(int n, int chunk) {
+    return (n + chunk - 1) / chunk;
+}
+
+// A batched world already has a worker to itself, so its passes run inline
+void sim_run(TaskFn fn, int count) {
+    if (!world->batched) {
+        pool_run(&sim_pool, fn, NULL, count);
+        return;
+    }
+    for (int k = 0; k < count; k++) fn(NULL, k);
+}
+
+void cloud_chunk(void* ctx, int k) {
+    int end = SDL_min(world->clouds.count, (k + 1) * SIM_CHUNK);
+    world->cloud_moves.count[k] = 0;
+    for (int i = k * SIM_CHUNK; i < end; i++) {
+        Motion* c = &world->clouds.motion[i];
+        c->x += c->vx;
+        c->y += c->vy;
+        c->vx *= 0.97f;
+        c->vy *= 0.97f;
+        wrap(&c->x, &c->y);
+        grid_stage(&world->cloud_grid, &world->cloud_moves, k, i, c->x, c->y);
+    }
+}
+
+// AI retargeting draws from RNG_AI, so it runs serially before the chunked
+// pass. Each creature retargets every 200 ticks, staggered by index.
+void creature_retarget() {
+    for (int i = world->frame % 200; i < world->creatures.count; i += 200) {
+        const Motion* n = &world->creatures.motion[i];
+        CreatureInfo* info = &world->creatures.info[i];
+        float dist_to_ship = distance(n->x, n->y, world->ship.x, world->ship.y);
+        if (dist_to_ship > 600.0f) {
+            float dir_to_ship = fast_atan2(world->ship.y - n->y, world->ship.x - n->x);
+            float offset = (rng_int(RNG_AI, 100) - 50) / 100.0f * M_PI / 2;
+            float target_dir = dir_to_ship + offset;
+            float target_dist = 300 + rng_int(RNG_AI, 400);
+            info->target_x = n->x + fast_cos(target_dir) * target_dist;
+            info->target_y = n->y + fast_sin(target_dir) * target_dist;
+        } else {
+            float random_dir = rng_float(RNG_AI) * 2 * M_PI;
+            float target_dist = 200 + rng_int(RNG_AI, 300);
+            info->target_x = n->x + fast_cos(random_dir) * target_dist;
+            info->target_y = n->y + fast_sin(random_dir) * target_dist;
+        }
+    }
+}
+
+void creature_chunk(void* ctx, int k) {
+    int end = SDL_min(world->creatures.count, (k + 1) * SIM_CHUNK);
+    world->creature_moves.count[k] = 0;
+    for (int i = k * SIM_CHUNK; i < end; i++) {
+        Motion* n = &world->creatures.motion[i];
+        CreatureSteer* st = &world->creatures.steer[i];
+        
+        st->wiggle += 0.09f;
+        
+        float dist_to_ship = distance(n->x, n->y, world->ship.x, world->ship.y);
+        
+        float dir;
+        float dx = world->ship.x - n->x;
+        float dy = world->ship.y - n->y;
+        if (fabsf(dx) > WORLD_W / 2) dx -= (dx > 0 ? WORLD_W : -WORLD_W);
+        if (fabsf(dy) > WORLD_H / 2) dy -= (dy > 0 ? WORLD_H : -WORLD_H);
+        dir = fast_atan2(dy, dx);
+        float ws, wc;
+        fast_sincos(st->wiggle, &ws, &wc);
+        
+        if (st->type == 0) {
+            if (dist_to_ship < 420) {
+                n->vx += fast_cos(dir) * 0.028f;
+                n->vy += fast_sin(dir) * 0.028f;
+            } else {
+                n->vx += fast_cos(dir) * 0.03f;
+                n->vy += fast_sin(dir) * 0.03f;
+            }
+        } else if (st->type == 1) {
+            if (dist_to_ship < 500) {
+                n->vx += fast_cos(dir) * 0.045f + ws * 0.06f;
+                n->vy += fast_sin(dir) * 0.045f + wc * 0.06f;
+            } else {
+                n->vx += fast_cos(dir) * 0.035f + ws * 0.03f;
+                n->vy += fast_sin(dir) * 0.035f + wc * 0.03f;
+            }
+        } else {
+            if (dist_to_ship < 380) {
+                float offset = (dist_to_ship < 180) ? -M_PI/2 : M_PI/2;
+                dir += offset + ws*0.3f;
+                n->vx += fast_cos(dir) * 0.036f;
+                n->vy += fast_sin(dir) * 0.036f;
+            } else {
+                n->vx += fast_cos(dir) * 0.03f;
+                n->vy += fast_sin(dir) * 0.03f;
+            }
+        }
+        
+        st->angle = fast_atan2(n->vy, n->vx);
+        n->x += n->vx;
+        n->y += n->vy;
+        n->vx *= 0.975f;
+        n->vy *= 0.975f;
+        wrap(&n->x, &n->y);
+        grid_stage(&world->creature_grid, &world->creature_moves, k, i, n->x, n->y);
+    }
+}
+
+void particle_chunk(void* ctx, int k) {
+    particles_integrate(&world->particles, k * PARTICLE_CHUNK, SDL_min(world->particles.count, (k + 1) * PARTICLE_CHUNK));
+}
+
+void update() {
+    PROF_BEGIN(PROF_TICK);
+    PROF_BEGIN(PROF_SHIP);
+    Uint8 input = world->input_source();
+    if (recorder.file && !rollback.resimulating) record_input(input);
+    int left = (input & INPUT_LEFT) != 0;
+    int right = (input & INPUT_RIGHT) != 0;
+    int thrust = (input & INPUT_THRUST) != 0;
+    bool tractor = (input & INPUT_TRACTOR) != 0;
+    
+    store_prev_state();
+    particle_budget_begin_tick();
+    world->frame++;
+    world->scrollX += 0.9f + world->danger_level * 0.12f;
+    world->danger_level = fminf(1.3f, world->danger_level + 0.00008f * world->clouds.count);
+    
+    if (tractor && !world->prev_tractor) world->ship.tractor_active = true;
+    if (tractor) {
+        world->ship.tractor_charge += 0.25f;
+        if (!world->ship.combo_boost_active) world->ship.fuel -= 0.12f;
+    } else {
+        world->ship.tractor_active = false;
+        world->ship.tractor_charge = fmaxf(0, world->ship.tractor_charge - 0.4f);
+    }
+    world->prev_tractor = tractor;
+    
+    if (world->ship.combo >= COMBO_BOOST_THRESHOLD && !world->ship.combo_boost_active) {
+        world->ship.combo_boost_active = true;
+        world->ship.combo_boost_timer = COMBO_BOOST_DURATION;
+    }
+    if (world->ship.combo_boost_active) {
+        world->ship.combo_boost_timer--;
+        if (world->ship.combo_boost_timer <= 0) {
+            world->ship.combo_boost_active = false;
+        }
+    }
+    
+    if (world->cosmetics) {
+        world->sun.pulse_phase += 0.018f;
+        for (int i = 0; i < MAX_NEBULAE; i++) {
+            world->nebulas[i].swirl += 0.003f;
+            world->nebulas[i].pulse += 0.012f;
+        }
+        for (int i = 0; i < NUM_PLANETS; i++) {
+            world->planets[i].spin += 0.0018f;
+            world->planets[i].base_x -= 0.11f + world->danger_level * 0.007f;
+            if (world->planets[i].base_x < -400) {
+                world->planets[i].base_x = WORLD_W + 600 + rng_int(RNG_FX, 400);
+                world->planets[i].base_y = 120 + rng_int(RNG_FX, 350);
+            }
+        }
+    }
+    
+    if (left) world->ship.angle -= SHIP_ROT_SPEED;
+    if (right) world->ship.angle += SHIP_ROT_SPEED;
+    
+    float effective_thrust = SHIP_THRUST;
+    if (is_critical_overheat(&world->ship)) effective_thrust *= OVERHEAT_THRUST_PENALTY;
+    
+    if (thrust && world->ship.fuel > 5.0f) {
+        float s, c;
+        fast_sincos(world->ship.angle, &s, &c);
+        world->ship.vx += c * effective_thrust;
+        world->ship.vy += s * effective_thrust;
+        world->ship.fuel -= FUEL_CONSUMPTION;
+        world->ship.heat += HEAT_GAIN_PER_THRUST;
+        thrust_flame();
+    }
+    
+    float decay = is_critical_overheat(&world->ship) ? HEAT_DECAY_CRITICAL : HEAT_DECAY_NORMAL;
+    world->ship.heat = fmaxf(0, world->ship.heat - decay);
+    
+    world->ship.x += world->ship.vx;
+    world->ship.y += world->ship.vy;
+    
+    if (is_critical_overheat(&world->ship)) {
+        world->ship.vx *= OVERHEAT_DRAG_MULTIPLIER;
+        world->ship.vy *= OVERHEAT_DRAG_MULTIPLIER;
+        critical_overheat_effect();
+        
+        world->ship.overheat_damage_accumulator += OVERHEAT_DAMAGE_PER_SEC / SIM_HZ;
+        if (world->ship.overheat_damage_accumulator >= 1.0f) {
+            int damage = (int)world->ship.overheat_damage_accumulator;
+            world->ship.lives -= damage;
+            world->ship.overheat_damage_accumulator -= damage;
+            danger_trail(world->ship.x, world->ship.y);
+            if (world->ship.lives <= 0) {
+                if (!world->batched && !rollback.resimulating) printf("Game Over! (Overheated to death) Final Score: %d\n", world->ship.score);
+                world->game_overs++;
+                init_game();
+            }
+        }
+    } else {
+        world->ship.vx *= 0.985f;
+        world->ship.vy *= 0.985f;
+        world->ship.overheat_damage_accumulator = fmaxf(0, world->ship.overheat_damage_accumulator - 0.4f);
+    }
+    
+    wrap(&world->ship.x, &world->ship.y);
+    trail_emit();
+    
+    world->ship.fuel = fminf(1000.0f, world->ship.fuel + 0.35f);
+    
+    float current_range = world->ship.combo_boost_active ? TRACTOR_RANGE * 1.6f : TRACTOR_RANGE;
+    float current_pull = world->ship.combo_boost_active ? 1.5f : 1.0f;
+    
+    if (world->ship.tractor_active) {
+        int hits = grid_query(&world->cloud_grid, world->ship.x, world->ship.y, current_range, world->grid_query_buf, caps.max_clouds);
+        for (int k = 0; k < hits; k++) {
+            int i = world->grid_query_buf[k];
+            Motion* c = &world->clouds.motion[i];
+            float dx = world->ship.x - c->x;
+            float dy = world->ship.y - c->y;
+            float dist = fast_hypot(dx, dy);
+            if (dist > 0) {
+                float pull = world->clouds.info[i].pull_strength * fminf(world->ship.tractor_charge * 0.02f, current_pull);
+                c->vx += (dx / dist) * pull;
+                c->vy += (dy / dist) * pull;
+                tractor_beam_effect(world->ship.x, world->ship.y, c->x, c->y);
+            }
+        }
+    }
+    
+    PROF_END(PROF_SHIP);
+    
+    PROF_BEGIN(PROF_CLOUDS);
+    int chunks = chunk_count(world->clouds.count, SIM_CHUNK);
+    sim_run(cloud_chunk, chunks);
+    grid_apply_moves(&world->cloud_grid, &world->cloud_moves, chunks);
+    
+    // Harvest from the highest index down so swap-removal never moves a
+    // cloud that is still waiting to be processed
+    int harvested = grid_query(&world->cloud_grid, world->ship.x, world->ship.y, HARVEST_RANGE, world->grid_query_buf, caps.max_clouds);
+    for (int k = harvested - 1; k >= 0; k--) {
+        int i = world->grid_query_buf[k];
+        int value = world->clouds.info[i].value;
+        int points = value * (1 + world->ship.combo * 0.2f);
+        world->ship.score += points;
+        harvest_effect(world->clouds.motion[i].x, world->clouds.motion[i].y, value);
+        cloud_remove(i);
+        world->ship.combo++;
+        world->combo_timer = 300;
+        world->clouds_collected_this_wave++;
+        
+        if (world->clouds_collected_this_wave >= world->clouds_needed_for_next_wave) {
+            world->wave++;
+            world->clouds_collected_this_wave = 0;
+            world->clouds_needed_for_next_wave = CLOUDS_PER_WAVE_BASE + world->wave * 18;
+            world->wave_flash_timer = 180;
+            world->current_wave_display_timer = 180;
+            
+            for (int j = 0; j < WAVE_CREATURE_BONUS + world->wave / 2; j++) {
+                spawn_creature();
+            }
+            
+            world->danger_level += 0.2f;
+        }
+    }
+    
+    while (world->clouds.count < scaled_population(40 + (int)(world->danger_level * 35), caps.max_clouds, MAX_CLOUDS)) spawn_cloud();
+    PROF_END(PROF_CLOUDS);
+    
+    PROF_BEGIN(PROF_CREATURES);
+    creature_retarget();
+    // Contact is tested before the creatures move, against where they were at
+    // the start of the tick. Creatures are at most 42 units across, so
+    // anything that can touch the ship is within 42 + 28 of it.
+    int contacts = grid_query(&world->creature_grid, world->ship.x, world->ship.y, 42 + 28, world->grid_query_buf, caps.max_creatures);
+    for (int k = contacts - 1; k >= 0; k--) {
+        int i = world->grid_query_buf[k];
+        const Motion* n = &world->creatures.motion[i];
+        float size = world->creatures.info[i].size;
+        if (distance_sq(n->x, n->y, world->ship.x, world->ship.y) >= (size + 28) * (size + 28)) continue;
+        world->ship.lives--;
+        world->ship.fuel *= 0.4f;
+        world->ship.heat = OVERHEAT_MAX * 0.92f;
+        danger_trail(world->ship.x, world->ship.y);
+        creature_remove(i);
+        world->ship.combo = 0;
+        if (world->ship.lives <= 0) {
+            if (!world->batched && !rollback.resimulating) printf("Game Over! Final Score: %d\n", world->ship.score);
+            world->game_overs++;
+            init_game();
+            break;
+        }
+    }
+    
+    chunks = chunk_count(world->creatures.count, SIM_CHUNK);
+    sim_run(creature_chunk, chunks);
+    grid_apply_moves(&world->creature_grid, &world->creature_moves, chunks);
+    
+    if (world->frame % 520 == 0 && world->creatures.count < scaled_population(14 + (int)(world->danger_level * 12), caps.max_creatures, MAX_CREATURES)) {
+        spawn_creature();
+    }
+    PROF_END(PROF_CREATURES);
+    
+    PROF_BEGIN(PROF_PARTICLES);
+    sim_run(particle_chunk, chunk_count(world->particles.count, PARTICLE_CHUNK));
+    particles_compact(&world->particles);
+    PROF_END(PROF_PARTICLES);
+    
+    if (world->combo_timer > 0) world->combo_timer--;
+    else world->ship.combo = 0;
+    
+    if (world->wave_flash_timer > 0) world->wave_flash_timer--;
+    if (world->current_wave_display_timer > 0) world->current_wave_display_timer--;
+    if (!rollback.resimulating) input_log_tick();
+    PROF_END(PROF_TICK);
+}
+
+Uint8 rollback_input() {
+    return *rollback.inputs++;
+}
+
+// Runs n ticks with the given input, saving after each
+void rollback_advance(const Uint8* inputs, int n) {
+    Uint8 (*saved_source)() = world->input_source;
+    world->input_source = rollback_input;
+    rollback.inputs = inputs;
+    for (int i = 0; i < n; i++) {
+        update();
+        rollback_save();
+    }
+    world->input_source = saved_source;
+}
+
+// Rewinds k ticks and replays them with corrected input, ending up back at
+// the newest tick. Recording and replay checks skip the resimulated ticks.
+bool rollback_resimulate(int k, const Uint8* inputs) {
+    if (!rollback_restore(k)) return false;
+    rollback.resimulating = true;
+    rollback_advance(inputs, k);
+    rollback.resimulating = false;
+    return true;
+}
+
+void draw_ship() {
+    float sx = lerp_wrapped(view->ship.prev_x, view->ship.x, render_alpha, WORLD_W);
+    float sy = lerp_wrapped(view->ship.prev_y, view->ship.y, render_alpha, WORLD_H);
+    float sa = lerp_wrapped(view->ship.prev_angle, view->ship.angle, render_alpha, 2 * M_PI);
+    float heat_ratio = view->ship.heat / (float)OVERHEAT_MAX;
+    float heat_glow = fminf(heat_ratio, 1.3f);
+
+    Uint8 r = 255;
+    Uint8 g = (Uint8)(255 - heat_glow * 160);
+    Uint8 b = (Uint8)(120 + heat_glow * 40);
+    Uint8 alpha = 220 + (Uint8)(35 * sinf(render_frame * 0.25f));
+
+    if (is_critical_overheat(&view->ship)) {
+        if ((view->frame / 5) % 2 == 0) {
+            r = 255; g = 50; b = 30;
+            alpha = 255;
+        } else {
+            r = 230; g = 90; b = 50;
+            alpha = 200;
+        }
+    } else if (is_overheat_warning(&view->ship)) {
+        g = (Uint8)(g * 0.5f + 100);
+        b = (Uint8)(b * 0.3f + 30);
+    }
+
+    gfx_color(r, g, b, alpha);
+    
+    float nx = sx + cosf(sa) * 30;
+    float ny = sy + sinf(sa) * 30;
+    float lx = sx + cosf(sa + 2.4f) * 24;
+    float ly = sy + sinf(sa + 2.4f) * 24;
+    float rx = sx + cosf(sa - 2.4f) * 24;
+    float ry = sy + sinf(sa - 2.4f) * 24;
+    float corex = sx + cosf(sa) * 14;
+    float corey = sy + sinf(sa) * 14;
+    
+    thick_line((int)nx, (int)ny, (int)lx, (int)ly, 7);
+    thick_line((int)lx, (int)ly, (int)corex, (int)corey, 7);
+    thick_line((int)corex, (int)corey, (int)rx, (int)ry, 7);
+    thick_line((int)rx, (int)ry, (int)nx, (int)ny, 7);
+    
+    gfx_color(255, 240 - (int)(heat_glow * 120), 180, 200);
+    for (int r = 0; r < 12; r++) {
+        gfx_line((int)(sx - r), (int)sy, (int)(sx + r), (int)sy);
+        gfx_line((int)sx, (int)(sy - r), (int)sx, (int)(sy + r));
+    }
+    
+    if (view->ship.tractor_active) {
+        float pulse = sinf(render_frame * 0.3f) * 0.4f + 0.6f;
+        Uint8 beam_a = (Uint8)(180 + 75 * pulse);
+        gfx_color(120, 240, 255, beam_a);
+        for (int r = 0; r < 16; r += 3) {
+            gfx_line((int)(sx - r*1.4f), (int)sy, 
+                                     (int)(sx + r*1.4f), (int)sy);
+        }
+    }
+    
+    if (view->ship.combo > 0) {
+        float pulse = sinf(render_frame * 0.25f) * 0.5f + 0.5f;
+        Uint8 aura_a = (Uint8)(140 + 115 * pulse);
+        gfx_color(140, 255, 220, aura_a);
+        for (int r = 0; r < 14; r += 2) {
+            gfx_line((int)(sx - r), (int)(sy - r), 
+                                     (int)(sx + r), (int)(sy - r));
+            gfx_line((int)(sx - r), (int)(sy + r), 
+                                     (int)(sx + r), (int)(sy + r));
+        }
+    }
+
+    if (is_overheat_warning(&view->ship)) {
+        Uint8 glow_a = (Uint8)(80 + 120 * sinf(render_frame * 0.45f));
+        gfx_color(255, 140, 40, glow_a);
+        for (int r = 0; r < 22; r += 4) {
+            gfx_line((int)(sx - r*1.6f), (int)sy,
+                                     (int)(sx + r*1.6f), (int)sy);
+        }
+    }
+}
+
+// Render quality levels, picked by the frame-budget governor. They only thin
+// out what is drawn straight to the screen; sprites and cached tiles are
+// always rasterized at full detail, and the simulation never sees them.
+typedef struct {
+    const char* name;
+    int step_x2;         // scanline step multiplier, in halves
+    int particle_stride; // draw every n-th particle
+    int tentacle_div;    // creature tentacle count divisor
+    int star_stride;     // draw one star in n
+} LodLevel;
+
+const LodLevel lod_levels[] = {
+    {"full",    2, 1, 1, 1},
+    {"reduced", 3, 1, 1, 2},
+    {"low",     4, 2, 2, 2},
+    {"minimal", 6, 3, 2, 3},
+};
+#define LOD_COUNT ((int)SDL_arraysize(lod_levels))
+int lod = 0;
+
+// Shape rasterizers. Each one emits horizontal spans around (x, y), either to
+// the screen through gfx_line or, while raster_px is set, into a sprite bitmap.
+Uint32* raster_px = NULL;
+int raster_w = 0, raster_h = 0;
+SDL_Color raster_color;
+
+// Scanline step for a shape drawn at the current quality level
+int lod_step(int step) {
+    return raster_px ? step : step * lod_levels[lod].step_x2 / 2;
+}
+
+void shape_color(Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+    if (raster_px) raster_color = (SDL_Color){r, g, b, a};
+    else gfx_color(r, g, b, a);
+}
+
+void shape_span(int x1, int x2, int y) {
+    if (!raster_px) {
+        gfx_line(x1, y, x2, y);
+        return;
+    }
+    if (y < 0 || y >= raster_h) return;
+    if (x1 > x2) { int t = x1; x1 = x2; x2 = t; }
+    if (x1 < 0) x1 = 0;
+    if (x2 >= raster_w) x2 = raster_w - 1;
+    float sa = raster_color.a / 255.0f;
+    Uint32 plain = ((Uint32)raster_color.a << 24) | (raster_color.r << 16) | (raster_color.g << 8) | raster_color.b;
+    for (int x = x1; x <= x2; x++) {
+        Uint32* p = &raster_px[y * raster_w + x];
+        if (!(*p >> 24)) {
+            *p = plain;
+            continue;
+        }
+        float da = (*p >> 24) / 255.0f;
+        float oa = sa + da * (1 - sa);
+        if (oa <= 0) continue;
+        float dw = da * (1 - sa);
+        Uint8 r = (Uint8)((raster_color.r * sa + ((*p >> 16) & 255) * dw) / oa);
+        Uint8 g = (Uint8)((raster_color.g * sa + ((*p >> 8) & 255) * dw) / oa);
+        Uint8 b = (Uint8)((raster_color.b * sa + (*p & 255) * dw) / oa);
+        *p = ((Uint32)(oa * 255.0f + 0.5f) << 24) | (r << 16) | (g << 8) | b;
+    }
+}
+
+void shape_point(int x, int y) {
+    if (raster_px) shape_span(x, x, y);
+    else gfx_point(x, y);
+}
+
+void shape_cloud_halo(float x, float y, int rad) {
+    shape_color(255, 255, 255, 50);
+    int step = lod_step(7);
+    for (int dy = -rad*1.3f; dy <= rad*1.3f; dy += step) {
+        int w = (int)(sqrtf(rad*rad*1.7f - dy*dy) * 0.35f);
+        if (w > 0) shape_span((int)(x - w), (int)(x + w), (int)(y + dy));
+    }
+}
+
+void shape_cloud_body(float x, float y, int rad, float density, Uint32 color) {
+    shape_color((color>>16)&255, (color>>8)&255, color&255, 255);
+    int step = lod_step(3);
+    for (int dy = -rad; dy <= rad; dy += step) {
+        int w = (int)(sqrtf(rad*rad - dy*dy) * density * 0.9f);
+        shape_span((int)(x - w), (int)(x + w), (int)(y + dy));
+    }
+}
+
+void shape_vspan(int x, int y1, int y2) {
+    if (!raster_px) {
+        gfx_line(x, y1, x, y2);
+        return;
+    }
+    for (int y = y1; y <= y2; y++) shape_span(x, x, y);
+}
+
+void shape_cloud_core(float x, float y) {
+    shape_color(255, 255, 255, 220);
+    for (int r = 0; r < 8; r++) {
+        shape_span((int)(x - r), (int)(x + r), (int)y);
+        shape_vspan((int)x, (int)(y - r), (int)(y + r));
+    }
+}
+
+void shape_disc(float x, float y, int size, Uint32 rgba) {
+    shape_color((rgba>>16)&255, (rgba>>8)&255, rgba&255, (rgba>>24)&255);
+    for (int dy = -size; dy <= size; dy += 3) {
+        int w = (int)sqrtf(size*size - dy*dy);
+        shape_span((int)(x - w), (int)(x + w), (int)(y + dy));
+    }
+}
+
+void shape_planet(float x, float y, int r, float spin, Uint32 color) {
+    for (int dy = -r; dy <= r; dy += 4) {
+        int hw = (int)sqrtf(r*r - dy*dy);
+        float swirl = sinf(dy * 0.035f + spin * 5);
+        Uint8 alpha = 140 + (int)(95 * swirl);
+        shape_color((color>>16)&255, (color>>8)&255, color&255, alpha);
+        shape_span((int)(x - hw), (int)(x + hw), (int)(y + dy));
+    }
+}
+
+void shape_sun_glow(float x, float y, int sun_r) {
+    shape_color(255, 255, 180, 90);
+    int step = lod_step(9);
+    for (int r = sun_r + 55; r > sun_r + 18; r -= 12) {
+        for (int dy = -r; dy <= r; dy += step) {
+            int hw = (int)sqrtf(r*r - dy*dy);
+            shape_span((int)x - hw, (int)x + hw, (int)(y + dy));
+        }
+    }
+}
+
+void shape_sun_core(float x, float y, float sun_r) {
+    shape_color(255, 240, 140, 255);
+    int step = lod_step(5);
+    for (int dy = -sun_r; dy <= sun_r; dy += step) {
+        int hw = (int)sqrtf(sun_r*sun_r - dy*dy);
+        shape_span((int)x - hw, (int)x + hw, (int)(y + dy));
+    }
+}
+
+void shape_star(int x, int y, const Star* st, float twinkle) {
+    int br = (int)(st->brightness * twinkle);
+    shape_color(br, br, br + 40, 255);
+    for (int s = -st->size; s <= st->size; s++) {
+        shape_point(x + s, y);
+        shape_point(x, y + s);
+    }
+}
+
+void shape_debris(int x, int y, const Debris* d, float glint) {
+    int g = 100 + (int)(d->vx * 180 + glint * 35);
+    shape_color(g, g + 20, 180, 200);
+    for (int s = 0; s < d->size * 2 + 1; s++) shape_point(x + s, y);
+}
+
+void shape_nebula(float x, float y, const Nebula* n, float swirl, float brightness) {
+    int r = (int)n->radius;
+    shape_color((n->color>>16)&255, (n->color>>8)&255, n->color&255, (Uint8)(0x88 * brightness));
+    int step = lod_step(5);
+    for (int dy = -r; dy <= r; dy += step) {
+        float swirl_off = fast_sin((dy * 0.025f + swirl * 3) * 1.7f) * n->density * 35;
+        int hw = (int)(sqrtf(r*r - dy*dy) + swirl_off);
+        shape_span((int)(x - hw), (int)(x + hw), (int)(y + dy));
+    }
+    
+    // Very subtle core
+    shape_color(180, 190, 255, (Uint8)(70 * brightness));
+    for (int dy = -r/4; dy <= r/4; dy += 2 * step) {
+        int hw = (int)(sqrtf((r/4)*(r/4) - dy*dy) * 1.2f);
+        shape_span((int)(x - hw), (int)(x + hw), (int)(y + dy));
+    }
+}
+
+// Sprite cache: shapes whose look depends only on a few quantized parameters
+// are rasterized once into a texture (white where the caller tints them) and
+// blitted with color/alpha modulation. 8-way set associative, LRU per set.
+#define SPRITE_CACHE_SETS 128
+#define SPRITE_CACHE_WAYS 8
+#define SPRITE_MAX_HALF   200
+
+enum {
+    SPRITE_CLOUD_HALO = 1,
+    SPRITE_CLOUD_BODY,
+    SPRITE_CLOUD_CORE,
+    SPRITE_CREATURE_BODY,
+    SPRITE_PLANET,
+    SPRITE_SUN_GLOW,
+    SPRITE_SUN_CORE
+};
+
+#define PLANET_SPIN_STEPS 64
+
+typedef struct {
+    Uint32 key;
+    SDL_Texture* tex;
+    int half;
+    Uint32 last_used;
+} Sprite;
+
+bool use_sprite_cache = true;
+Sprite sprite_cache[SPRITE_CACHE_SETS][SPRITE_CACHE_WAYS];
+Uint32 sprite_scratch[(2 * SPRITE_MAX_HALF + 1) * (2 * SPRITE_MAX_HALF + 1)];
+Uint32 sprite_clock = 0;
+Uint64 sprite_hits = 0, sprite_misses = 0, sprite_evictions = 0;
+
+Uint32 sprite_key(int kind, int a, int b) {
+    return ((Uint32)kind << 28) | ((Uint32)(a & 0xFFF) << 16) | (Uint32)(b & 0xFFFF);
+}
+
+int sprite_half_extent(int kind, int a) {
+    switch (kind) {
+        case SPRITE_CLOUD_HALO: return (int)(a * 1.3f) + 1;
+        case SPRITE_CLOUD_CORE: return 8;
+        case SPRITE_SUN_GLOW:   return a + 56;
+        default:                return a + 1;
+    }
+}
+
+void sprite_rasterize(int kind, int a, int b, int half) {
+    float c = (float)half;
+    switch (kind) {
+        case SPRITE_CLOUD_HALO:    shape_cloud_halo(c, c, a); break;
+        case SPRITE_CLOUD_BODY:    shape_cloud_body(c, c, a, b / 100.0f, 0xFFFFFF); break;
+        case SPRITE_CLOUD_CORE:    shape_cloud_core(c, c); break;
+        case SPRITE_CREATURE_BODY: shape_disc(c, c, a, 0xFFFFFFFF); break;
+        case SPRITE_PLANET:        shape_planet(c, c, a, b * (2 * M_PI / 5.0f) / PLANET_SPIN_STEPS, 0xFFFFFF); break;
+        case SPRITE_SUN_GLOW:      shape_sun_glow(c, c, a); break;
+        case SPRITE_SUN_CORE:      shape_sun_core(c, c, (float)a); break;
+    }
+}
+
+Sprite* sprite_get(int kind, int a, int b) {
+    Uint32 key = sprite_key(kind, a, b);
+    Sprite* set = sprite_cache[(key * 2654435761u) >> 25];
+    Sprite* victim = &set[0];
+    for (int w = 0; w < SPRITE_CACHE_WAYS; w++) {
+        if (set[w].tex && set[w].key == key) {
+            set[w].last_used = sprite_clock;
+            sprite_hits++;
+            return &set[w];
+        }
+        if (!set[w].tex) victim = &set[w];
+        else if (victim->tex && set[w].last_used < victim->last_used) victim = &set[w];
+    }
+    
+    sprite_misses++;
+    int half = sprite_half_extent(kind, a);
+    if (half > SPRITE_MAX_HALF) return NULL;
+    int size = 2 * half + 1;
+    SDL_Texture* tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, size, size);
+    if (!tex) return NULL;
+    
+    memset(sprite_scratch, 0, sizeof(Uint32) * size * size);
+    raster_px = sprite_scratch;
+    raster_w = raster_h = size;
+    sprite_rasterize(kind, a, b, half);
+    raster_px = NULL;
+    SDL_UpdateTexture(tex, NULL, sprite_scratch, size * sizeof(Uint32));
+    SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+    
+    if (victim->tex) {
+        SDL_DestroyTexture(victim->tex);
+        sprite_evictions++;
+    }
+    *victim = (Sprite){key, tex, half, sprite_clock};
+    return victim;
+}
+
+// Blits the cached sprite centered on (x, y) tinted by rgba. Returns false if
+// the caller has to draw the shape directly instead.
+bool draw_sprite(int kind, int a, int b, float x, float y, Uint32 rgba) {
+    if (!use_sprite_cache || render_path == RENDER_SOFTWARE) return false;
+    Sprite* s = sprite_get(kind, a, b);
+    if (!s) return false;
+    gfx_flush();
+    SDL_SetTextureColorMod(s->tex, (rgba>>16)&255, (rgba>>8)&255, rgba&255);
+    SDL_SetTextureAlphaMod(s->tex, (rgba>>24)&255);
+    PROF_COLOR_CHANGE();
+    SDL_Rect dst = {(int)x - s->half, (int)y - s->half, 2 * s->half + 1, 2 * s->half + 1};
+    SDL_RenderCopy(renderer, s->tex, NULL, &dst);
+    PROF_DRAW_CALL();
+    return true;
+}
+
+void sprite_cache_clear() {
+    for (int i = 0; i < SPRITE_CACHE_SETS; i++) {
+        for (int w = 0; w < SPRITE_CACHE_WAYS; w++) {
+            if (sprite_cache[i][w].tex) SDL_DestroyTexture(sprite_cache[i][w].tex);
+            sprite_cache[i][w] = (Sprite){0};
+        }
+    }
+}
+
+void sprite_cache_report() {
+    Uint64 total = sprite_hits + sprite_misses;
+    printf("Sprite cache: %s, %llu hits, %llu misses (%.1f%% hit rate), %llu evictions\n",
+           use_sprite_cache ? "on" : "off",
+           (unsigned long long)sprite_hits, (unsigned long long)sprite_misses,
+           total ? 100.0 * sprite_hits / total : 0.0, (unsigned long long)sprite_evictions);
+}
+
+void draw_gas_cloud(const CloudStore* s, int i) {
+    const CloudInfo* c = &s->info[i];
+    float pulse = 0.8f + 0.2f * sinf(c->phase + render_frame * (CLOUD_PULSE_RATE + 0.14f));
+    int rad = (int)(c->size * pulse * c->density);
+    int density_pct = (int)(c->density * 100 + 0.5f);
+    float x = lerp_wrapped(s->prev[i].x, s->motion[i].x, render_alpha, WORLD_W);
+    float y = lerp_wrapped(s->prev[i].y, s->motion[i].y, render_alpha, WORLD_H);
+    
+    if (!draw_sprite(SPRITE_CLOUD_HALO, rad, 0, x, y, 0xFFFFFFFF))
+        shape_cloud_halo(x, y, rad);
+    if (!draw_sprite(SPRITE_CLOUD_BODY, rad, density_pct, x, y, c->color | 0xFF000000))
+        shape_cloud_body(x, y, rad, c->density, c->color);
+    if (!draw_sprite(SPRITE_CLOUD_CORE, 0, 0, x, y, 0xFFFFFFFF))
+        shape_cloud_core(x, y);
+}
+
+void draw_nebula_creature(const CreatureStore* s, int idx) {
+    const CreatureInfo* info = &s->info[idx];
+    const CreatureSteer* n = &s->steer[idx];
+    const Pose* prev = &s->prev[idx];
+    float pulse = 0.85f + 0.15f * fast_sin(render_frame * (0.18f + CREATURE_HUNT_RATE) + info->hunt_phase);
+    int size = (int)(info->size * pulse);
+    float x = lerp_wrapped(prev->x, s->motion[idx].x, render_alpha, WORLD_W);
+    float y = lerp_wrapped(prev->y, s->motion[idx].y, render_alpha, WORLD_H);
+    float ang0 = lerp_wrapped(prev->angle, n->angle, render_alpha, 2 * M_PI);
+    
+    if (!draw_sprite(SPRITE_CREATURE_BODY, size, 0, x, y, info->color))
+        shape_disc(x, y, size, info->color);
+    
+    // Tentacles, fewer (but still evenly spread) at lower quality
+    int div = lod_levels[lod].tentacle_div;
+    if (n->type == 0) {
+        gfx_color(200, 220, 255, 180);
+        int legs = (5 + div - 1) / div;
+        for (int i = 0; i < legs; i++) {
+            float ang = ang0 + i * 2 * M_PI / legs + fast_sin(n->wiggle + i) * 0.3f;
+            int ex = (int)(x + fast_cos(ang) * (size + 10));
+            int ey = (int)(y + fast_sin(ang) * (size + 10));
+            thick_line((int)x, (int)y, ex, ey, 2);
+        }
+    } else if (n->type == 1) {
+        gfx_color(255, 120, 120, 220);
+        int legs = (6 + div - 1) / div;
+        for (int i = 0; i < legs; i++) {
+            float ang = ang0 + i * 2 * M_PI / legs + fast_sin(n->wiggle + i) * 0.4f;
+            int ex = (int)(x + fast_cos(ang) * (size + 16));
+            int ey = (int)(y + fast_sin(ang) * (size + 16));
+            thick_line((int)x, (int)y, ex, ey, 4);
+        }
+    } else {
+        gfx_color(180, 100, 220, 200);
+        int legs = (8 + div - 1) / div;
+        for (int i = 0; i < legs; i++) {
+            float ang = ang0 + i * 2 * M_PI / legs + fast_sin(n->wiggle * 0.8f + i) * 0.6f;
+            int ex = (int)(x + fast_cos(ang) * (size + 18));
+            int ey = (int)(y + fast_sin(ang) * (size + 18));
+            thick_line((int)x, (int)y, ex, ey, 3);
+        }
+    }
+    
+    float dist_to_ship = distance(s->motion[idx].x, s->motion[idx].y, view->ship.x, view->ship.y);
+    if (dist_to_ship < CREATURE_DANGER_DIST) {
+        Uint8 glow = (Uint8)(255 * (1.0f - dist_to_ship / CREATURE_DANGER_DIST));
+        gfx_color(255, 80, 80, glow);
+        for (int r = 0; r < 20; r += 4) {
+            gfx_line((int)(x - r), (int)y, (int)(x + r), (int)y);
+        }
+    }
+}
+
+void draw_particles() {
+    const ParticlePool* pp = &view->particles;
+    int stride = lod_levels[lod].particle_stride;
+    for (int i = 0; i < pp->count; i += stride) {
+        int alpha = (int)(255 * (pp->life[i] / 60.0f));
+        if (alpha < 25) continue;
+        Uint32 color = pp->color[i];
+        gfx_color((color>>16)&255, (color>>8)&255, color&255, alpha);
+        int px = (int)lerp_wrapped(pp->prev_x[i], pp->x[i], render_alpha, WORLD_W);
+        int py = (int)lerp_wrapped(pp->prev_y[i], pp->y[i], render_alpha, WORLD_H);
+        gfx_point(px, py);
+        if (alpha > 100) {
+            gfx_point(px+1, py);
+            gfx_point(px, py+1);
+        }
+    }
+}
+
+// Bucketed particle renderer: particles are grouped by RGB and a quantized
+// alpha level with a counting sort, then each bucket is one
+// SDL_RenderDrawPoints call, however many particles are alive.
+#define PARTICLE_ALPHA_LEVELS 8
+#define MAX_PARTICLE_BUCKETS  128
+#define PARTICLE_BUCKET_SLOTS 256
+
+typedef struct {
+    Uint32 rgb;
+    int level;
+    int count, offset;
+} ParticleBucket;
+
+typedef struct {
+    ParticleBucket buckets[MAX_PARTICLE_BUCKETS];
+    int bucket_cnt;
+    Uint8* bucket_of;       // per particle; 0xFF = not drawn
+    SDL_Point* points;      // up to 3 points per particle
+    int submissions;
+    int points_drawn;
+} ParticleRenderer;
+
+bool use_particle_buckets = true;
+bool show_particle_stats = false;
+ParticleRenderer particle_renderer;
+
+void particle_renderer_init(ParticleRenderer* pr, Arena* a, int capacity) {
+    pr->bucket_of = arena_alloc(a, capacity);
+    pr->points = arena_alloc(a, capacity * 3 * sizeof(SDL_Point));
+}
+
+int particle_bucket_for(ParticleRenderer* pr, Uint8* slots, Uint32 rgb, int level) {
+    Uint32 h = ((rgb * 2654435761u) ^ (level * 0x9E3779B9u)) >> 24;
+    for (int probe = 0; probe < PARTICLE_BUCKET_SLOTS; probe++) {
+        Uint8* slot = &slots[(h + probe) & (PARTICLE_BUCKET_SLOTS - 1)];
+        if (*slot == 0xFF) {
+            if (pr->bucket_cnt >= MAX_PARTICLE_BUCKETS) break;
+            *slot = pr->bucket_cnt;
+            pr->buckets[pr->bucket_cnt] = (ParticleBucket){rgb, level, 0, 0};
+            return pr->bucket_cnt++;
+        }
+        ParticleBucket* b = &pr->buckets[*slot];
+        if (b->rgb == rgb && b->level == level) return *slot;
+    }
+    // Table full: share a bucket of the same color, or the first one
+    for (int i = 0; i < pr->bucket_cnt; i++) {
+        if (pr->buckets[i].rgb == rgb) return i;
+    }
+    return 0;
+}
+
+void draw_particles_bucketed() {
+    const ParticlePool* pp = &view->particles;
+    ParticleRenderer* pr = &particle_renderer;
+    Uint8 slots[PARTICLE_BUCKET_SLOTS];
+    memset(slots, 0xFF, sizeof(slots));
+    pr->bucket_cnt = 0;
+    
+    int stride = lod_levels[lod].particle_stride;
+    for (int i = 0; i < pp->count; i++) {
+        int alpha = (int)(255 * (pp->life[i] / 60.0f));
+        if (alpha < 25 || i % stride) {
+            pr->bucket_of[i] = 0xFF;
+            continue;
+        }
+        int level = (Uint8)alpha * PARTICLE_ALPHA_LEVELS / 256;
+        int b = particle_bucket_for(pr, slots, pp->color[i] & 0xFFFFFF, level);
+        pr->bucket_of[i] = b;
+        pr->buckets[b].count += alpha > 100 ? 3 : 1;
+    }
+    
+    int total = 0;
+    for (int b = 0; b < pr->bucket_cnt; b++) {
+        pr->buckets[b].offset = total;
+        total += pr->buckets[b].count;
+        pr->buckets[b].count = 0;
+    }
+    
+    for (int i = 0; i < pp->count; i++) {
+        if (pr->bucket_of[i] == 0xFF) continue;
+        ParticleBucket* b = &pr->buckets[pr->bucket_of[i]];
+        int px = (int)lerp_wrapped(pp->prev_x[i], pp->x[i], render_alpha, WORLD_W);
+        int py = (int)lerp_wrapped(pp->prev_y[i], pp->y[i], render_alpha, WORLD_H);
+        SDL_Point* out = &pr->points[b->offset + b->count];
+        out[0] = (SDL_Point){px, py};
+        b->count++;
+        if ((int)(255 * (pp->life[i] / 60.0f)) > 100) {
+            out[1] = (SDL_Point){px + 1, py};
+            out[2] = (SDL_Point){px, py + 1};
+            b->count += 2;
+        }
+    }
+    
+    gfx_flush();
+    pr->submissions = 0;
+    pr->points_drawn = total;
+    for (int b = 0; b < pr->bucket_cnt; b++) {
+        ParticleBucket* bk = &pr->buckets[b];
+        if (bk->count == 0) continue;
+        Uint8 a = (Uint8)((bk->level * 256 + 128) / PARTICLE_ALPHA_LEVELS);
+        SDL_SetRenderDrawColor(renderer, (bk->rgb>>16)&255, (bk->rgb>>8)&255, bk->rgb&255, a);
+        SDL_RenderDrawPoints(renderer, &pr->points[bk->offset], bk->count);
+        PROF_COLOR_CHANGE();
+        PROF_DRAW_CALL();
+        pr->submissions++;
+    }
+    if (render_path == RENDER_IMMEDIATE) SDL_SetRenderDrawColor(renderer, draw_color.r, draw_color.g, draw_color.b, draw_color.a);
+}
+
+// Parallax layer cache. Stars and debris only ever translate with the scroll,
+// so each layer is rasterized tile by tile into a ring of texture columns and
+// composited with the scroll offset: a couple of copies per tile instead of a
+// draw call per point. The twinkle is baked into LAYER_FRAMES phases stacked
+// down the texture, and the two nearest phases are crossfaded with alpha
+// modulation. A tile is rebuilt only when it scrolls into view. Nebulae get a
+// texture each, re-rasterized when their swirl has moved on by a step, a few
+// per frame at most.
+#define LAYER_RING     FIELD_VIEW_TILES
+#define LAYER_FRAMES   4
+#define LAYER_MARGIN   8     // widest star or debris overhang into the next tile
+
+#define NEBULA_SWIRL_STEP         0.02f   // about 7 ticks; edges move a few pixels per step
+#define NEBULA_REBUILDS_PER_FRAME 2
+#define NEBULA_MAX_HALF_W         330
+#define NEBULA_MAX_HALF_H         300
+
+#define LAYER_SCRATCH_PX SDL_max(FIELD_TILE_W * WORLD_H, (2 * NEBULA_MAX_HALF_W + 1) * (2 * NEBULA_MAX_HALF_H + 1))
+
+// Draws `count` tiles of a layer starting at `first`, with the left edge of
+// tile `first` at x0 and the twinkle at `phase`, skipping anything outside
+// [min_x, max_x)
+typedef void (*LayerDrawFn)(int first, int count, float x0, float phase, float min_x, float max_x);
+
+typedef struct {
+    SDL_Texture* tex;           // LAYER_RING tiles across, LAYER_FRAMES phases down
+    int slot_tile[LAYER_RING];  // layer tile held by each ring slot
+    Uint32 seed;                // starfield_seed the tiles were built from
+    float parallax;             // fraction of the scroll the layer moves by
+    float rate;                 // twinkle phase advance per frame
+    LayerDrawFn draw;
+} ParallaxLayer;
+
+typedef struct {
+    SDL_Texture* tex;
+    Nebula built;        // the nebula as it was rasterized
+    int swirl_step;
+    int half_w, half_h;
+} NebulaSprite;
+
+// The stars or debris in view are generated into field_stars / field_debris,
+// then their twinkle is evaluated in one batch
+void star_layer_draw(int first, int count, float x0, float phase, float min_x, float max_x) {
+    int n = field_stars_in(view->starfield_seed, first, count, field_stars);
+    int visible = 0;
+    for (int i = 0; i < n; i++) {
+        float x = x0 + field_stars[i].base_x;
+        if (x < min_x || x >= max_x) continue;
+        field_stars[visible] = field_stars[i];
+        trig_x[visible] = x;
+        trig_arg[visible++] = phase + field_stars[i].phase;
+    }
+    fast_sincos_array(trig_arg, trig_sin, trig_cos, visible);
+    int stride = raster_px ? 1 : lod_levels[lod].star_stride;
+    for (int k = 0; k < visible; k++) {
+        const Star* st = &field_stars[k];
+        if (st->phase % stride) continue;   // phase is random per star, so the same ones stay
+        shape_star((int)floorf(trig_x[k]), (int)st->base_y, st, 0.65f + 0.35f * trig_sin[k]);
+    }
+}
+
+void debris_layer_draw(int first, int count, float x0, float phase, float min_x, float max_x) {
+    int n = field_debris_in(view->starfield_seed, first, count, field_debris);
+    int visible = 0;
+    for (int i = 0; i < n; i++) {
+        float x = x0 + field_debris[i].base_x;
+        if (x < min_x || x >= max_x) continue;
+        field_debris[visible] = field_debris[i];
+        trig_x[visible] = x;
+        trig_arg[visible++] = phase + field_debris[i].phase;
+    }
+    fast_sincos_array(trig_arg, trig_sin, trig_cos, visible);
+    for (int k = 0; k < visible; k++) {
+        const Debris* d = &field_debris[k];
+        shape_debris((int)floorf(trig_x[k]), (int)d->base_y, d, trig_sin[k]);
+    }
+}
+
+bool use_layer_cache = true;
+ParallaxLayer star_layer = {.parallax = 0.18f, .rate = 0.09f, .draw = star_layer_draw};
+ParallaxLayer debris_layer = {.parallax = 0.45f, .rate = 0.06f, .draw = debris_layer_draw};
+NebulaSprite nebula_sprites[MAX_NEBULAE];
+Uint32 layer_scratch[LAYER_SCRATCH_PX];
+Uint64 layer_tile_builds = 0, nebula_builds = 0;
+
+void layer_build_tile(ParallaxLayer* l, int tile, int slot) {
+    raster_px = layer_scratch;
+    raster_w = FIELD_TILE_W;
+    raster_h = WORLD_H;
+    for (int f = 0; f < LAYER_FRAMES; f++) {
+        memset(layer_scratch, 0, sizeof(Uint32) * FIELD_TILE_W * WORLD_H);
+        // The neighbours too, for whatever overhangs into this tile
+        l->draw(tile - 1, 3, -FIELD_TILE_W, f * (2 * M_PI / LAYER_FRAMES), -LAYER_MARGIN, FIELD_TILE_W + LAYER_MARGIN);
+        SDL_Rect dst = {slot * FIELD_TILE_W, f * WORLD_H, FIELD_TILE_W, WORLD_H};
+        SDL_UpdateTexture(l->tex, &dst, layer_scratch, FIELD_TILE_W * sizeof(Uint32));
+    }
+    raster_px = NULL;
+    l->slot_tile[slot] = tile;
+    layer_tile_builds++;
+}
+
+// Draws the visible tiles of a layer, from the cache when it can
+void draw_layer(ParallaxLayer* l) {
+    float scroll = render_scroll * l->parallax;
+    int first = (int)floorf(scroll / FIELD_TILE_W);
+    float x0 = (float)first * FIELD_TILE_W - scroll;
+    if (!use_layer_cache || render_path == RENDER_SOFTWARE) {
+        l->draw(first, FIELD_VIEW_TILES, x0, render_frame * l->rate, -LAYER_MARGIN, WORLD_W);
+        return;
+    }
+    if (!l->tex) {
+        l->tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+                                   LAYER_RING * FIELD_TILE_W, LAYER_FRAMES * WORLD_H);
+        if (!l->tex) {
+            use_layer_cache = false;
+            l->draw(first, FIELD_VIEW_TILES, x0, render_frame * l->rate, -LAYER_MARGIN, WORLD_W);
+            return;
+        }
+        SDL_SetTextureBlendMode(l->tex, SDL_BLENDMODE_BLEND);
+        for (int k = 0; k < LAYER_RING; k++) l->slot_tile[k] = INT_MIN;
+    }
+    if (l->seed != view->starfield_seed) {
+        for (int k = 0; k < LAYER_RING; k++) l->slot_tile[k] = INT_MIN;
+        l->seed = view->starfield_seed;
+    }
+    
+    float phase = fast_wrap(render_frame * l->rate, 2 * M_PI, 1 / (2 * M_PI)) * (LAYER_FRAMES / (2 * M_PI));
+    int f0 = (int)phase % LAYER_FRAMES;
+    int f1 = (f0 + 1) % LAYER_FRAMES;
+    Uint8 fade = (Uint8)((phase - (int)phase) * 255);
+    
+    // f0 fades out as f1 is added on top, so a star that is only lit in one
+    // of the phases ramps rather than popping when the phases step on
+    gfx_flush();
+    for (int pass = 0; pass < (fade ? 2 : 1); pass++) {
+        SDL_SetTextureAlphaMod(l->tex, pass ? fade : 255 - fade);
+        SDL_SetTextureBlendMode(l->tex, pass ? SDL_BLENDMODE_ADD : SDL_BLENDMODE_BLEND);
+        PROF_COLOR_CHANGE();
+        for (int k = 0; k < LAYER_RING; k++) {
+            int tile = first + k, slot = (tile % LAYER_RING + LAYER_RING) % LAYER_RING;
+            int x = (int)floorf(x0) + k * FIELD_TILE_W;
+            if (x >= WORLD_W) break;
+            if (l->slot_tile[slot] != tile) layer_build_tile(l, tile, slot);
+            SDL_Rect src = {slot * FIELD_TILE_W, (pass ? f1 : f0) * WORLD_H, FIELD_TILE_W, WORLD_H};
+            SDL_Rect dst = {x, 0, FIELD_TILE_W, WORLD_H};
+            SDL_RenderCopy(renderer, l->tex, &src, &dst);
+            PROF_DRAW_CALL();
+        }
+    }
+    SDL_SetTextureBlendMode(l->tex, SDL_BLENDMODE_BLEND);
+}
+
+float nebula_screen_x(const Nebula* n) {
+    return n->x - render_scroll * 0.08f;
+}
+
+bool nebula_visible(const Nebula* n) {
+    float nx = nebula_screen_x(n);
+    return n->active && nx >= -400 && nx <= WORLD_W + 400;
+}
+
+// How far behind a nebula's texture is, or INT_MAX if it shows another nebula
+int nebula_staleness(const NebulaSprite* ns, const Nebula* n) {
+    if (!ns->tex || ns->built.radius != n->radius || ns->built.density != n->density || ns->built.color != n->color) return INT_MAX;
+    return abs((int)floorf(n->swirl / NEBULA_SWIRL_STEP) - ns->swirl_step);
+}
+
+void nebula_build(NebulaSprite* ns, const Nebula* n) {
+    int r = (int)n->radius;
+    int half_w = r + (int)(n->density * 35) + 2, half_h = r + 1;
+    if (half_w > NEBULA_MAX_HALF_W || half_h > NEBULA_MAX_HALF_H) return;
+    if (!ns->tex) {
+        ns->tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+                                    2 * NEBULA_MAX_HALF_W + 1, 2 * NEBULA_MAX_HALF_H + 1);
+        if (!ns->tex) return;
+        SDL_SetTextureBlendMode(ns->tex, SDL_BLENDMODE_BLEND);
+    }
+    int swirl_step = (int)floorf(n->swirl / NEBULA_SWIRL_STEP);
+    raster_px = layer_scratch;
+    raster_w = 2 * half_w + 1;
+    raster_h = 2 * half_h + 1;
+    memset(layer_scratch, 0, sizeof(Uint32) * raster_w * raster_h);
+    shape_nebula((float)half_w, (float)half_h, n, swirl_step * NEBULA_SWIRL_STEP, 1.0f);
+    SDL_UpdateTexture(ns->tex, &(SDL_Rect){0, 0, raster_w, raster_h}, layer_scratch, raster_w * sizeof(Uint32));
+    raster_px = NULL;
+    ns->built = *n;
+    ns->swirl_step = swirl_step;
+    ns->half_w = half_w;
+    ns->half_h = half_h;
+    nebula_builds++;
+}
+
+// Rebuilds the stalest visible nebula textures, within the per-frame budget
+void nebula_sprites_update() {
+    if (!use_layer_cache || render_path == RENDER_SOFTWARE) return;
+    for (int budget = NEBULA_REBUILDS_PER_FRAME; budget > 0; budget--) {
+        int stalest = -1, worst = 0;
+        for (int i = 0; i < MAX_NEBULAE; i++) {
+            if (!nebula_visible(&view->nebulas[i])) continue;
+            int staleness = nebula_staleness(&nebula_sprites[i], &view->nebulas[i]);
+            if (staleness > worst) {
+                worst = staleness;
+                stalest = i;
+            }
+        }
+        if (stalest < 0) break;
+        nebula_build(&nebula_sprites[stalest], &view->nebulas[stalest]);
+        if (nebula_staleness(&nebula_sprites[stalest], &view->nebulas[stalest])) break;   // could not build
+    }
+}
+
+void draw_nebula(int i) {
+    const Nebula* n = &view->nebulas[i];
+    if (!nebula_visible(n)) return;
+    float nx = nebula_screen_x(n);
+    float brightness_pulse = 0.9f + 0.1f * fast_sin(n->pulse);
+    
+    const NebulaSprite* ns = &nebula_sprites[i];
+    if (use_layer_cache && render_path != RENDER_SOFTWARE && nebula_staleness(ns, n) != INT_MAX) {
+        gfx_flush();
+        SDL_SetTextureAlphaMod(ns->tex, (Uint8)(255 * brightness_pulse));
+        PROF_COLOR_CHANGE();
+        SDL_Rect src = {0, 0, 2 * ns->half_w + 1, 2 * ns->half_h + 1};
+        SDL_Rect dst = {(int)nx - ns->half_w, (int)n->y - ns->half_h, src.w, src.h};
+        SDL_RenderCopy(renderer, ns->tex, &src, &dst);
+        PROF_DRAW_CALL();
+        return;
+    }
+    shape_nebula(nx, n->y, n, n->swirl, brightness_pulse);
+}
+
+void layer_cache_clear() {
+    ParallaxLayer* layers[] = {&star_layer, &debris_layer};
+    for (int k = 0; k < (int)SDL_arraysize(layers); k++) {
+        if (layers[k]->tex) SDL_DestroyTexture(layers[k]->tex);
+        layers[k]->tex = NULL;
+    }
+    for (int i = 0; i < MAX_NEBULAE; i++) {
+        if (nebula_sprites[i].tex) SDL_DestroyTexture(nebula_sprites[i].tex);
+        nebula_sprites[i] = (NebulaSprite){0};
+    }
+}
+
+void layer_cache_report() {
+    printf("Layer cache: %s, %llu tile builds, %llu nebula builds\n", use_layer_cache ? "on" : "off",
+           (unsigned long long)layer_tile_builds, (unsigned long long)nebula_builds);
+}
+
+// HUD cache. The digits are rasterized once into a glyph atlas, and each HUD
+// panel into its own texture, rebuilt only when what it shows changes: the
+// score, the wave, or the lives and bar widths in whole pixels. Per-frame
+// pulses are color and alpha mods on those textures.
+#define GLYPH_PAD (DIGIT_THICK / 2)
+#define GLYPH_W (DIGIT_W + 2 * GLYPH_PAD + 1)
+#define GLYPH_H (DIGIT_H + 2 * GLYPH_PAD + 1)
+#define HUD_BAR_W 220
+
+enum { HUD_SCORE, HUD_STATUS, HUD_WAVE, HUD_PANEL_COUNT };
+
+typedef struct {
+    SDL_Rect at;      // on screen
+    SDL_Texture* tex;
+    Uint64 key;       // what the texture was built from
+    bool built;
+} HudPanel;
+
+bool use_hud_cache = true;
+HudPanel hud_panels[HUD_PANEL_COUNT] = {
+    [HUD_SCORE]  = {{WORLD_W - 60 - 5 * 42 - GLYPH_PAD, 10 - GLYPH_PAD, 5 * 42 + GLYPH_W, GLYPH_H}},
+    [HUD_STATUS] = {{30, 16, 240, 94}},
+    [HUD_WAVE]   = {{WORLD_W - 100 - GLYPH_PAD, WORLD_H - 58 - GLYPH_PAD, 35 + GLYPH_W, GLYPH_H}},
+};
+Uint32 glyph_px[GLYPH_H * 10 * GLYPH_W];   // one row of ten cells
+bool glyph_px_ready = false;
+SDL_Texture* glyph_tex = NULL;
+Uint32 hud_scratch[240 * 94];
+Uint64 hud_builds = 0;
+
+void shape_fill_rect(int x, int y, int w, int h) {
+    if (w <= 0 || h <= 0) return;
+    if (!raster_px) {
+        gfx_fill_rect((SDL_Rect){x, y, w, h});
+        return;
+    }
+    for (int r = y; r < y + h; r++) shape_span(x, x + w - 1, r);
+}
+
+// The spans thick_line draws for each lit segment
+void shape_digit(int bx, int by, int digit) {
+    int w = DIGIT_W, h = DIGIT_H, t = GLYPH_PAD;
+    const bool* seg = digit_segments[digit];
+    if (seg[0]) shape_fill_rect(bx, by - t, w + 1, 2 * t + 1);
+    if (seg[1]) shape_fill_rect(bx - t, by, 2 * t + 1, h / 2 + 1);
+    if (seg[2]) shape_fill_rect(bx + w - t, by, 2 * t + 1, h / 2 + 1);
+    if (seg[3]) shape_fill_rect(bx, by + h / 2 - t, w + 1, 2 * t + 1);
+    if (seg[4]) shape_fill_rect(bx - t, by + h / 2, 2 * t + 1, h / 2 + 1);
+    if (seg[5]) shape_fill_rect(bx + w - t, by + h / 2, 2 * t + 1, h / 2 + 1);
+    if (seg[6]) shape_fill_rect(bx, by + h - t, w + 1, 2 * t + 1);
+}
+
+void glyph_atlas_build() {
+    if (glyph_px_ready) return;
+    raster_px = glyph_px;
+    raster_w = 10 * GLYPH_W;
+    raster_h = GLYPH_H;
+    shape_color(255, 255, 255, 255);
+    for (int d = 0; d < 10; d++) shape_digit(d * GLYPH_W + GLYPH_PAD, GLYPH_PAD, d);
+    raster_px = NULL;
+    glyph_px_ready = true;
+}
+
+SDL_Texture* glyph_atlas_texture() {
+    if (glyph_tex) return glyph_tex;
+    glyph_atlas_build();
+    glyph_tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, 10 * GLYPH_W, GLYPH_H);
+    if (!glyph_tex) return NULL;
+    SDL_UpdateTexture(glyph_tex, NULL, glyph_px, 10 * GLYPH_W * sizeof(Uint32));
+    SDL_SetTextureBlendMode(glyph_tex, SDL_BLENDMODE_BLEND);
+    return glyph_tex;
+}
+
+// A 7-segment digit in the current draw color, from the atlas when it can
+void draw_digit(int x, int y, int digit) {
+    if (digit < 0 || digit > 9) return;
+    if (raster_px) {
+        // Building a panel: copy the glyph's lit pixels into it
+        for (int r = 0; r < GLYPH_H; r++) {
+            int py = y - GLYPH_PAD + r;
+            if (py < 0 || py >= raster_h) continue;
+            for (int c = 0; c < GLYPH_W; c++) {
+                int px = x - GLYPH_PAD + c;
+                Uint32 v = glyph_px[r * 10 * GLYPH_W + digit * GLYPH_W + c];
+                if (v && px >= 0 && px < raster_w) raster_px[py * raster_w + px] = v;
+            }
+        }
+        return;
+    }
+    SDL_Texture* tex = use_hud_cache && render_path != RENDER_SOFTWARE ? glyph_atlas_texture() : NULL;
+    if (!tex) {
+        draw_7segment_digit(x, y, digit);
+        return;
+    }
+    gfx_flush();
+    SDL_SetTextureColorMod(tex, draw_color.r, draw_color.g, draw_color.b);
+    SDL_SetTextureAlphaMod(tex, draw_color.a);
+    PROF_COLOR_CHANGE();
+    SDL_Rect src = {digit * GLYPH_W, 0, GLYPH_W, GLYPH_H};
+    SDL_Rect dst = {x - GLYPH_PAD, y - GLYPH_PAD, GLYPH_W, GLYPH_H};
+    SDL_RenderCopy(renderer, tex, &src, &dst);
+    PROF_DRAW_CALL();
+}
+
+// Draws a non-negative number left to right in 7-segment digits
+void draw_number(int x, int y, int value) {
+    char buf[12];
+    int len = snprintf(buf, sizeof(buf), "%d", value < 0 ? 0 : value);
+    for (int i = 0; i < len; i++) draw_digit(x + i * 30, y, buf[i] - '0');
+}
+
+int hud_fuel_fill() {
+    return (int)((view->ship.fuel / 1000.0f) * HUD_BAR_W);
+}
+
+int hud_heat_fill() {
+    return (int)((view->ship.heat / OVERHEAT_MAX) * HUD_BAR_W);
+}
+
+int hud_heat_state() {
+    return is_critical_overheat(&view->ship) ? 2 : is_overheat_warning(&view->ship) ? 1 : 0;
+}
+
+Uint64 hud_panel_key(int p) {
+    switch (p) {
+        case HUD_SCORE: return (Uint64)(view->ship.score % 1000000);
+        case HUD_WAVE:  return (Uint64)view->wave;
+        default:
+            return (Uint64)(Uint16)view->ship.lives | (Uint64)(Uint16)hud_fuel_fill() << 16 |
+                   (Uint64)(Uint16)hud_heat_fill() << 32 | (Uint64)hud_heat_state() << 48;
+    }
+}
+
+// Draws a panel's contents shifted by (ox, oy), to the screen or into the
+// panel bitmap. The digit panels draw in the current color.
+void hud_panel_draw(int p, int ox, int oy) {
+    if (p == HUD_SCORE) {
+        // Digits grow from the right (least significant first)
+        int value = view->ship.score % 1000000;
+        for (int i = 0; i < 6; i++, value /= 10) draw_digit(WORLD_W - 60 - i * 42 + ox, 10 + oy, value % 10);
+    } else if (p == HUD_WAVE) {
+        draw_digit(WORLD_W - 100 + 35 + ox, WORLD_H - 58 + oy, view->wave % 10);
+        if (view->wave >= 10) draw_digit(WORLD_W - 100 + ox, WORLD_H - 58 + oy, (view->wave / 10) % 10);
+    } else {
+        shape_color(180, 255, 180, 255);
+        for (int i = 0; i < view->ship.lives; i++) {
+            int lx = 40 + i * 45 + ox;
+            shape_fill_rect(lx, 18 + oy, 31, 5);
+            shape_fill_rect(lx + 8, 28 + oy, 15, 5);
+        }
+        shape_color(40, 60, 80, 220);
+        shape_fill_rect(30 + ox, 70 + oy, 240, 18);
+        shape_color(80, 200, 255, 255);
+        shape_fill_rect(33 + ox, 73 + oy, hud_fuel_fill(), 12);
+        
+        shape_color(100, 40, 40, 220);
+        shape_fill_rect(30 + ox, 95 + oy, 240, 14);
+        static const Uint8 heat_rgb[3][3] = {{255, 100, 80}, {255, 140, 40}, {255, 60, 40}};
+        const Uint8* c = heat_rgb[hud_heat_state()];
+        shape_color(c[0], c[1], c[2], 255);
+        shape_fill_rect(33 + ox, 98 + oy, hud_heat_fill(), 8);
+    }
+}
+
+void hud_panel_build(HudPanel* h, int p, Uint64 key) {
+    glyph_atlas_build();
+    raster_px = hud_scratch;
+    raster_w = h->at.w;
+    raster_h = h->at.h;
+    memset(hud_scratch, 0, sizeof(Uint32) * raster_w * raster_h);
+    shape_color(255, 255, 255, 255);
+    hud_panel_draw(p, -h->at.x, -h->at.y);
+    raster_px = NULL;
+    SDL_UpdateTexture(h->tex, NULL, hud_scratch, h->at.w * sizeof(Uint32));
+    h->key = key;
+    h->built = true;
+    hud_builds++;
+}
+
+// Draws a panel tinted by rgba (the digit panels are white underneath)
+void draw_hud_panel(int p, Uint32 rgba) {
+    HudPanel* h = &hud_panels[p];
+    if (use_hud_cache && render_path != RENDER_SOFTWARE && !h->tex) {
+        h->tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, h->at.w, h->at.h);
+        if (!h->tex) use_hud_cache = false;
+        else SDL_SetTextureBlendMode(h->tex, SDL_BLENDMODE_BLEND);
+        h->built = false;
+    }
+    if (!use_hud_cache || render_path == RENDER_SOFTWARE) {
+        gfx_color((rgba>>16)&255, (rgba>>8)&255, rgba&255, (rgba>>24)&255);
+        hud_panel_draw(p, 0, 0);
+        return;
+    }
+    Uint64 key = hud_panel_key(p);
+    if (!h->built || h->key != key) hud_panel_build(h, p, key);
+    gfx_flush();
+    SDL_SetTextureColorMod(h->tex, (rgba>>16)&255, (rgba>>8)&255, rgba&255);
+    SDL_SetTextureAlphaMod(h->tex, (rgba>>24)&255);
+    PROF_COLOR_CHANGE();
+    SDL_RenderCopy(renderer, h->tex, NULL, &h->at);
+    PROF_DRAW_CALL();
+}
+
+void hud_cache_clear() {
+    for (int p = 0; p < HUD_PANEL_COUNT; p++) {
+        if (hud_panels[p].tex) SDL_DestroyTexture(hud_panels[p].tex);
+        hud_panels[p].tex = NULL;
+        hud_panels[p].built = false;
+    }
+    if (glyph_tex) SDL_DestroyTexture(glyph_tex);
+    glyph_tex = NULL;
+}
+
+void hud_cache_report() {
+    printf("HUD cache: %s, %llu panel builds\n", use_hud_cache ? "on" : "off", (unsigned long long)hud_builds);
+}
+
+void draw_frame() {
+    sprite_clock++;
+    render_frame = view->frame - 1 + render_alpha;
+    render_scroll = view->prev_scrollX + (view->scrollX - view->prev_scrollX) * render_alpha;
+    PROF_BEGIN(PROF_BACKGROUND);
+    gfx_clear(3, 3, 12);
+    
+    draw_layer(&star_layer);
+    draw_layer(&debris_layer);
+    
+    float sun_pulse = 1.0f + 0.12f * fast_sin(view->sun.pulse_phase);
+    float sun_r = view->sun.radius * sun_pulse;
+    if (!draw_sprite(SPRITE_SUN_GLOW, (int)sun_r, 0, view->sun.base_x, view->sun.base_y, 0xFFFFFFFF))
+        shape_sun_glow(view->sun.base_x, view->sun.base_y, (int)sun_r);
+    if (!draw_sprite(SPRITE_SUN_CORE, (int)sun_r, 0, view->sun.base_x, view->sun.base_y, 0xFFFFFFFF))
+        shape_sun_core(view->sun.base_x, view->sun.base_y, sun_r);
+    
+    // Draw nebulae
+    nebula_sprites_update();
+    for (int i = 0; i < MAX_NEBULAE; i++) draw_nebula(i);
+    
+    for (int i = 0; i < NUM_PLANETS; i++) {
+        const Planet* p = &view->planets[i];
+        float px = p->base_x - render_scroll * 0.12f;
+        if (px < -350 || px > WORLD_W + 350) continue;
         
-        n->hunt_phase += 0.04f;
-        n->wiggle += 0.09f;
-        n->patrol_phase += 0.025f;
+        int r = (int)p->radius;
+        float spin_turns = p->spin * 5 / (2 * M_PI);
+        int spin_step = (int)((spin_turns - floorf(spin_turns)) * PLANET_SPIN_STEPS) % PLANET_SPIN_STEPS;
+        if (!draw_sprite(SPRITE_PLANET, r, spin_step, px, p->base_y, p->color | 0xFF000000))
+            shape_planet(px, p->base_y, r, p->spin, p->color);
+    }
+    
+    PROF_END(PROF_BACKGROUND);
+    
+    PROF_BEGIN(PROF_ENTITIES);
+    for (int i = 0; i < view->clouds.count; i++) draw_gas_cloud(&view->clouds, i);
+    for (int i = 0; i < view->creatures.count; i++) draw_nebula_creature(&view->creatures, i);
+    PROF_END(PROF_ENTITIES);
+    
+    PROF_BEGIN(PROF_PARTICLE_DRAW);
+    if (use_particle_buckets && render_path != RENDER_SOFTWARE) draw_particles_bucketed();
+    else draw_particles();
+    PROF_END(PROF_PARTICLE_DRAW);
+    
+    PROF_BEGIN(PROF_ENTITIES);
+    draw_ship();
+    PROF_END(PROF_ENTITIES);
+    
+    PROF_BEGIN(PROF_HUD);
+    draw_hud_panel(HUD_SCORE, 0xFFFFFFFF);
+    draw_hud_panel(HUD_STATUS, 0xFFFFFFFF);
+    
+    // Combo meter (unchanged)
+    if (view->ship.combo > 0) {
+        int combo_w = view->ship.combo * 10;
+        int max_w = 200;
+        if (combo_w > max_w) combo_w = max_w;
         
-        float dist_to_ship = distance(n->x, n->y, ship.x, ship.y);
+        float pulse = sinf(render_frame * 0.35f) * 0.5f + 0.5f;
+        Uint8 r = 255;
+        Uint8 g = 220 + (Uint8)(35 * pulse);
+        Uint8 b = 100 + (Uint8)(100 * pulse);
+        Uint8 a = (Uint8)(200 + 55 * pulse);
         
-        if (frame % 200 == i % 200) {
-            if (dist_to_ship > 600.0f) {
-                float dir_to_ship = atan2f(ship.y - n->y, ship.x - n->x);
-                float offset = (rand() % 100 - 50) / 100.0f * M_PI / 2;
-                float target_dir = dir_to_ship + offset;
-                float target_dist = 300 + rand() % 400;
-                n->target_x = n->x + cosf(target_dir) * target_dist;
-                n->target_y = n->y + sinf(target_dir) * target_dist;
-            } else {
-                float random_dir = rand() * 2 * M_PI / RAND_MAX;
-                float target_dist = 200 + rand() % 300;
-                n->target_x = n->x + cosf(random_dir) * target_dist;
-                n->target_y = n->y + sinf(random_dir) * target_dist;
-            }
-        }
+        gfx_color(r, g, b, a);
+        gfx_fill_rect((SDL_Rect){WORLD_W/2 - combo_w/2, 20, combo_w, 24});
         
-        float dir;
-        float dx = ship.x - n->x;
-        float dy = ship.y - n->y;
-        if (fabsf(dx) > WINDOW_W / 2) dx -= (dx > 0 ? WINDOW_W : -WINDOW_W);
-        if (fabsf(dy) > WINDOW_H / 2) dy -= (dy > 0 ? WINDOW_H : -WINDOW_H);
-        dir = atan2f(dy, dx);
+        gfx_color(255, 255, 255, (Uint8)(100 + 155 * pulse));
+        gfx_rect((SDL_Rect){WORLD_W/2 - combo_w/2 - 3, 17, combo_w + 6, 30});
         
-        if (n->type == 0) {
-            if (dist_to_ship < 420) {
-                n->vx += cosf(dir) * 0.028f;
-                n->vy += sinf(dir) * 0.028f;
-            } else {
-                n->vx += cosf(dir) * 0.03f;
-                n->vy += sinf(dir) * 0.03f;
-            }
-        } else if (n->type == 1) {
-            if (dist_to_ship < 500) {
-                n->vx += cosf(dir) * 0.045f + sinf(n->wiggle) * 0.06f;
-                n->vy += sinf(dir) * 0.045f + cosf(n->wiggle) * 0.06f;
-            } else {
-                n->vx += cosf(dir) * 0.035f + sinf(n->wiggle) * 0.03f;
-                n->vy += sinf(dir) * 0.035f + cosf(n->wiggle) * 0.03f;
-            }
-        } else {
-            if (dist_to_ship < 380) {
-                float offset = (dist_to_ship < 180) ? -M_PI/2 : M_PI/2;
-                dir += offset + sinf(n->wiggle)*0.3f;
-                n->vx += cosf(dir) * 0.036f;
-                n->vy += sinf(dir) * 0.036f;
-            } else {
-                n->vx += cosf(dir) * 0.03f;
-                n->vy += sinf(dir) * 0.03f;
+        if (view->ship.combo_boost_active) {
+            gfx_color(255, 220, 50, 255);
+            for (int off = 0; off < 8; off += 2) {
+                gfx_rect((SDL_Rect){WORLD_W/2 - combo_w/2 - 8 - off, 12 - off, combo_w + 16 + off*2, 40 + off*2});
             }
         }
+    }
+    
+    // Wave indicator (numbers only, bottom-right)
+    draw_hud_panel(HUD_WAVE, 0xFFC8C8C8);
+    
+    // Flash yellow when advancing
+    if (view->current_wave_display_timer > 0) {
+        Uint8 flash_alpha = (Uint8)(180 + 75 * sinf(render_frame * 0.5f));
+        draw_hud_panel(HUD_WAVE, (Uint32)flash_alpha << 24 | 0xFFFF64);
+    }
+    
+    if (show_particle_stats && use_particle_buckets) {
+        // Bottom-left: live particles, buckets used, draw submissions
+        gfx_color(120, 200, 255, 200);
+        draw_number(30, WORLD_H - 140, view->particles.count);
+        gfx_color(180, 255, 180, 200);
+        draw_number(30, WORLD_H - 95, particle_renderer.bucket_cnt);
+        gfx_color(255, 220, 120, 200);
+        draw_number(30, WORLD_H - 50, particle_renderer.submissions);
         
-        n->angle = atan2f(n->vy, n->vx);
-        n->x += n->vx;
-        n->y += n->vy;
-        n->vx *= 0.975f;
-        n->vy *= 0.975f;
-        wrap(&n->x, &n->y);
-        
-        if (dist_to_ship < n->size + 28) {
-            ship.lives--;
-            ship.fuel *= 0.4f;
-            ship.heat = OVERHEAT_MAX * 0.92f;
-            danger_trail(ship.x, ship.y);
-            n->active = 0;
-            creatures[i] = creatures[--creature_cnt];
-            ship.combo = 0;
-            if (ship.lives <= 0) {
-                printf("Game Over! Final Score: %d\n", ship.score);
-                init_game();
-            }
+        // Live particles per emitter as a stacked bar, full width = pool capacity
+        static const Uint8 emitter_rgb[EMITTER_COUNT][3] = {
+            {170, 238, 255}, {255, 68, 68}, {255, 136, 0}, {255, 255, 204}, {102, 221, 255}, {204, 238, 255},
+        };
+        int bx = 30;
+        for (int e = 0; e < EMITTER_COUNT; e++) {
+            int w = view->particles.live[e] * 300 / view->particles.capacity;
+            gfx_color(emitter_rgb[e][0], emitter_rgb[e][1], emitter_rgb[e][2], 200);
+            gfx_fill_rect((SDL_Rect){bx, WORLD_H - 170, w, 10});
+            bx += w;
+        }
+        gfx_color(255, 255, 255, 120);
+        gfx_rect((SDL_Rect){30, WORLD_H - 171, 300, 12});
+    }
+    PROF_END(PROF_HUD);
+}
+
+#ifndef HARVESTER_NO_PROFILER
+#define PROF_HISTORY    120   // frames or ticks in the overlay graphs
+#define PROF_PX_PER_MS  6
+
+ProfEvent prof_scratch[PROF_RING];
+
+// Copies the newest events of a track, oldest first, into prof_scratch and
+// returns how many. The writer never waits, so anything it may have
+// overwritten while they were being copied is dropped.
+int prof_read(int track, int max) {
+    ProfTrack* t = &prof_tracks[track];
+    Uint32 head = (Uint32)SDL_AtomicGet(&t->head);
+    Uint32 n = SDL_min(SDL_min(head, (Uint32)max), (Uint32)PROF_RING);
+    for (Uint32 i = 0; i < n; i++) prof_scratch[i] = t->events[(head - n + i) & (PROF_RING - 1)];
+    // Slots written meanwhile, plus the one that may be in progress
+    Uint32 after = (Uint32)SDL_AtomicGet(&t->head);
+    Sint64 lost = (Sint64)after + 1 - PROF_RING - ((Sint64)head - n);
+    if (lost <= 0) return n;
+    if (lost >= n) return 0;
+    memmove(prof_scratch, prof_scratch + lost, (n - lost) * sizeof(ProfEvent));
+    return n - lost;
+}
+
+// Milliseconds per phase for each of the last PROF_HISTORY root events of a
+// track (frames or ticks); the phases logged since the previous root count
+// towards it. Returns how many roots there were, oldest first in ms.
+int prof_history(int track, int root, float ms[PROF_HISTORY][PROF_PHASE_COUNT]) {
+    int n = prof_read(track, 16 * PROF_HISTORY);
+    double to_ms = 1000.0 / SDL_GetPerformanceFrequency();
+    float acc[PROF_PHASE_COUNT] = {0};
+    int roots = 0;
+    for (int i = 0; i < n; i++) {
+        const ProfEvent* e = &prof_scratch[i];
+        acc[e->phase] += (float)((e->end - e->start) * to_ms);
+        if (e->phase != root) continue;
+        memcpy(ms[roots % PROF_HISTORY], acc, sizeof(acc));
+        memset(acc, 0, sizeof(acc));
+        roots++;
+    }
+    // Rotate the ring of rows into oldest-first order
+    int count = SDL_min(roots, PROF_HISTORY);
+    static float rows[PROF_HISTORY][PROF_PHASE_COUNT];
+    for (int k = 0; k < count; k++) memcpy(rows[k], ms[(roots - count + k) % PROF_HISTORY], sizeof(rows[k]));
+    memcpy(ms, rows, count * sizeof(rows[0]));
+    return count;
+}
+
+// One bar per root: its phases stacked bottom up, then whatever the root
+// spent outside them in its own color. The line marks the 60 Hz budget.
+void draw_profile_graph(int track, int root, int x, int base_y) {
+    static float ms[PROF_HISTORY][PROF_PHASE_COUNT];
+    int count = prof_history(track, root, ms);
+    int max_h = 130;
+    for (int k = 0; k < count; k++) {
+        int bx = x + (PROF_HISTORY - count + k) * 3;
+        float y = (float)base_y, other = ms[k][root];
+        for (int p = 0; p < PROF_PHASE_COUNT; p++) {
+            if (p == root || prof_phases[p].track != track || ms[k][p] <= 0) continue;
+            other -= ms[k][p];
+            float h = fminf(ms[k][p] * PROF_PX_PER_MS, y - (base_y - max_h));
+            gfx_color(prof_phases[p].rgb[0], prof_phases[p].rgb[1], prof_phases[p].rgb[2], 220);
+            gfx_fill_rect((SDL_Rect){bx, (int)(y - h), 2, (int)ceilf(h)});
+            y -= h;
+        }
+        if (other > 0) {
+            float h = fminf(other * PROF_PX_PER_MS, y - (base_y - max_h));
+            gfx_color(prof_phases[root].rgb[0], prof_phases[root].rgb[1], prof_phases[root].rgb[2], 120);
+            gfx_fill_rect((SDL_Rect){bx, (int)(y - h), 2, (int)ceilf(h)});
+        }
+    }
+    gfx_color(255, 255, 255, 90);
+    gfx_fill_rect((SDL_Rect){x, base_y - (int)(1000.0f / SIM_HZ * PROF_PX_PER_MS), PROF_HISTORY * 3, 1});
+}
+
+// Bottom-center: sim ticks above, render frames below, and to the right the
+// last frame's time in tenths of a millisecond, draw calls and color changes
+void draw_profiler() {
+    int x = WORLD_W / 2 - PROF_HISTORY * 3 / 2 - 60;
+    gfx_color(0, 0, 0, 150);
+    gfx_fill_rect((SDL_Rect){x - 10, WORLD_H - 300, PROF_HISTORY * 3 + 160, 290});
+    draw_profile_graph(PROF_TRACK_SIM, PROF_TICK, x, WORLD_H - 160);
+    draw_profile_graph(PROF_TRACK_RENDER, PROF_FRAME, x, WORLD_H - 20);
+    
+    int n = prof_read(PROF_TRACK_RENDER, 64);
+    for (int i = n - 1; i >= 0; i--) {
+        const ProfEvent* e = &prof_scratch[i];
+        if (e->phase != PROF_FRAME) continue;
+        int nx = x + PROF_HISTORY * 3 + 15;
+        gfx_color(255, 255, 255, 220);
+        draw_number(nx, WORLD_H - 290, (int)((e->end - e->start) * 10000 / SDL_GetPerformanceFrequency()));
+        gfx_color(255, 220, 120, 220);
+        draw_number(nx, WORLD_H - 245, e->draw_calls);
+        gfx_color(170, 238, 255, 220);
+        draw_number(nx, WORLD_H - 200, e->color_changes);
+        break;
+    }
+}
+
+// Writes the events still in the rings to <prefix>.csv and, in Chrome's
+// trace event format, to <prefix>.json
+bool prof_export(const char* prefix) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s.csv", prefix);
+    FILE* csv = fopen(path, "w");
+    snprintf(path, sizeof(path), "%s.json", prefix);
+    FILE* json = fopen(path, "w");
+    if (!csv || !json) {
+        if (csv) fclose(csv);
+        if (json) fclose(json);
+        return false;
+    }
+    double to_us = 1e6 / SDL_GetPerformanceFrequency();
+    fprintf(csv, "track,phase,start_us,duration_us,draw_calls,color_changes\n");
+    fprintf(json, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    int written = 0;
+    for (int t = 0; t < PROF_TRACK_COUNT; t++) {
+        fprintf(json, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                t ? ",\n" : "", t + 1, prof_track_names[t]);
+        int n = prof_read(t, PROF_RING);
+        for (int i = 0; i < n; i++) {
+            const ProfEvent* e = &prof_scratch[i];
+            double start = (double)(Sint64)(e->start - prof_epoch) * to_us;
+            double dur = (double)(e->end - e->start) * to_us;
+            fprintf(csv, "%s,%s,%.3f,%.3f,%u,%u\n", prof_track_names[t], prof_phases[e->phase].name,
+                    start, dur, e->draw_calls, e->color_changes);
+            fprintf(json, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"args\":{\"draw_calls\":%u,\"color_changes\":%u}}",
+                    prof_phases[e->phase].name, prof_track_names[t], t + 1, start, dur, e->draw_calls, e->color_changes);
+        }
+        written += n;
+    }
+    fprintf(json, "\n]}\n");
+    bool ok = !ferror(csv) && !ferror(json);
+    fclose(csv);
+    fclose(json);
+    printf("Profile: %d events written to %s.csv and %s.json\n", written, prefix, prefix);
+    return ok;
+}
+#endif
+
+// Frame-budget governor. Keeps a smoothed estimate of the render time (draw
+// and submit, not the wait for vsync) and steps the quality level down when
+// it stays near the budget, and back up only once it has stayed well under
+// it for a couple of seconds.
+#define GOV_SMOOTHING   0.1    // weight of the newest frame in the estimate
+#define GOV_HIGH        0.90   // share of the budget that counts as over
+#define GOV_LOW         0.55   // and as comfortably under
+#define GOV_DOWN_FRAMES 30
+#define GOV_UP_FRAMES   150
+
+typedef struct {
+    bool enabled;
+    double budget_ms;
+    double estimate_ms;
+    int over, under;    // consecutive frames past each threshold
+    Uint64 changes;
+} Governor;
+
+Governor governor = {.enabled = true, .budget_ms = 1000.0 / 60};
+
+void governor_frame(double ms) {
+    Governor* g = &governor;
+    if (!g->enabled) return;
+    g->estimate_ms = g->estimate_ms > 0 ? g->estimate_ms + (ms - g->estimate_ms) * GOV_SMOOTHING : ms;
+    g->over = g->estimate_ms > g->budget_ms * GOV_HIGH ? g->over + 1 : 0;
+    g->under = g->estimate_ms < g->budget_ms * GOV_LOW ? g->under + 1 : 0;
+    // With dynamic resolution, resolution goes first and comes back last
+    int next = lod;
+    float scale = render_scale;
+    if (g->over >= GOV_DOWN_FRAMES) {
+        if (dynamic_resolution && render_scale > RENDER_DYNAMIC_MIN) scale = SDL_max(RENDER_DYNAMIC_MIN, render_scale - RENDER_SCALE_STEP);
+        else if (lod < LOD_COUNT - 1) next = lod + 1;
+    } else if (g->under >= GOV_UP_FRAMES) {
+        if (lod > 0) next = lod - 1;
+        else if (dynamic_resolution && render_scale < render_scale_max) scale = SDL_min(render_scale_max, render_scale + RENDER_SCALE_STEP);
+    }
+    if (next != lod) {
+        printf("Governor: %.2f ms against a %.2f ms budget, quality %s -> %s\n",
+               g->estimate_ms, g->budget_ms, lod_levels[lod].name, lod_levels[next].name);
+        lod = next;
+    } else if (scale != render_scale) {
+        printf("Governor: %.2f ms against a %.2f ms budget, render scale %.3f -> %.3f\n",
+               g->estimate_ms, g->budget_ms, render_scale, scale);
+        set_render_scale(scale);
+    } else {
+        return;
+    }
+    g->over = g->under = 0;
+    g->changes++;
+}
+
+void governor_report() {
+    printf("Governor: %s, %.2f ms budget, %.2f ms estimate, quality %s, render scale %.3f (%dx%d%s), %llu changes\n",
+           governor.enabled ? "on" : "off", governor.budget_ms, governor.estimate_ms, lod_levels[lod].name,
+           render_scale, render_w, render_h, dynamic_resolution ? ", dynamic" : "", (unsigned long long)governor.changes);
+}
+
+bool use_frame_target = true;
+SDL_Texture* frame_target = NULL;
+int frame_target_w = 0, frame_target_h = 0;
+
+// The offscreen target at the current render resolution
+bool frame_target_ready() {
+    if (frame_target && frame_target_w == render_w && frame_target_h == render_h) return true;
+    if (frame_target) SDL_DestroyTexture(frame_target);
+    frame_target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, render_w, render_h);
+    if (!frame_target) {
+        fprintf(stderr, "No offscreen target (%s), drawing straight to the window\n", SDL_GetError());
+        return false;
+    }
+    SDL_SetTextureScaleMode(frame_target, SDL_ScaleModeLinear);
+    frame_target_w = render_w;
+    frame_target_h = render_h;
+    return true;
+}
+
+// Where the frame goes in the window: as large as fits at the world's aspect
+SDL_Rect frame_rect(int out_w, int out_h) {
+    int w = out_w, h = out_w * WORLD_H / WORLD_W;
+    if (h > out_h) {
+        h = out_h;
+        w = out_h * WORLD_W / WORLD_H;
+    }
+    return (SDL_Rect){(out_w - w) / 2, (out_h - h) / 2, w, h};
+}
+
+void render() {
+    Uint64 start = SDL_GetPerformanceCounter();
+    int out_w = WORLD_W, out_h = WORLD_H;
+    SDL_GetRendererOutputSize(renderer, &out_w, &out_h);
+    SDL_Rect dst = frame_rect(out_w, out_h);
+    // Straight into the window when the frame fills it at the render resolution
+    bool offscreen = use_frame_target && !(dst.w == out_w && dst.h == out_h && render_w == out_w && render_h == out_h);
+    if (offscreen && !frame_target_ready()) use_frame_target = offscreen = false;
+    if (offscreen) {
+        SDL_SetRenderTarget(renderer, frame_target);
+        SDL_RenderSetScale(renderer, (float)render_w / WORLD_W, (float)render_h / WORLD_H);
+    } else {
+        // Letterboxed at a uniform scale, which is also the fallback when
+        // there is no frame target. The viewport is set unscaled.
+        SDL_RenderSetScale(renderer, 1.0f, 1.0f);
+        SDL_RenderSetViewport(renderer, NULL);
+        if (dst.w != out_w || dst.h != out_h) {
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+            SDL_RenderClear(renderer);
+            if (render_path == RENDER_IMMEDIATE) SDL_SetRenderDrawColor(renderer, draw_color.r, draw_color.g, draw_color.b, draw_color.a);
+        }
+        SDL_RenderSetViewport(renderer, &dst);
+        SDL_RenderSetScale(renderer, (float)dst.w / WORLD_W, (float)dst.w / WORLD_W);
+    }
+    if (render_path == RENDER_SOFTWARE) sw_init();
+    PROF_BEGIN(PROF_FRAME);
+    draw_frame();
+#ifndef HARVESTER_NO_PROFILER
+    if (show_profiler) {
+        PROF_BEGIN(PROF_OVERLAY);
+        draw_profiler();
+        PROF_END(PROF_OVERLAY);
+    }
+#endif
+    PROF_BEGIN(PROF_PRESENT);
+    gfx_finish();
+    if (offscreen) {
+        SDL_SetRenderTarget(renderer, NULL);
+        SDL_RenderSetScale(renderer, 1.0f, 1.0f);
+        SDL_RenderSetViewport(renderer, NULL);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, frame_target, NULL, &dst);
+        PROF_DRAW_CALL();
+        if (render_path == RENDER_IMMEDIATE) SDL_SetRenderDrawColor(renderer, draw_color.r, draw_color.g, draw_color.b, draw_color.a);
+    }
+    governor_frame((double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+    SDL_RenderPresent(renderer);
+    PROF_END(PROF_PRESENT);
+    PROF_END(PROF_FRAME);
+}
+
+// Draws the current frame with the software rasterizer and with the SDL
+// renderer (into a target texture), then reports both timings and how many
+// pixels differ.
+void compare_render_paths() {
+    int saved = render_path;
+    int sdl_path = saved == RENDER_SOFTWARE ? RENDER_BATCHED : saved;
+    // Pixel for pixel at world size, whatever the render resolution
+    float saved_scale = render_scale;
+    set_render_scale(1.0f);
+    if (!sw_init()) {
+        set_render_scale(saved_scale);
+        return;
+    }
+    SDL_Texture* target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, WORLD_W, WORLD_H);
+    Uint32* readback = malloc(WORLD_W * WORLD_H * sizeof(Uint32));
+    if (!target || !readback) {
+        fprintf(stderr, "Render path comparison unavailable: %s\n", SDL_GetError());
+        if (target) SDL_DestroyTexture(target);
+        free(readback);
+        set_render_scale(saved_scale);
+        return;
+    }
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    
+    render_path = RENDER_SOFTWARE;
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    draw_frame();
+    sw_rasterize();
+    double sw_ms = (double)(SDL_GetPerformanceCounter() - t0) * 1000.0 / freq;
+    
+    render_path = sdl_path;
+    SDL_SetRenderTarget(renderer, target);
+    t0 = SDL_GetPerformanceCounter();
+    draw_frame();
+    gfx_finish();
+    SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, readback, WORLD_W * sizeof(Uint32));
+    double sdl_ms = (double)(SDL_GetPerformanceCounter() - t0) * 1000.0 / freq;
+    SDL_SetRenderTarget(renderer, NULL);
+    render_path = saved;
+    
+    long differing = 0, beyond_tolerance = 0;
+    int max_delta = 0;
+    for (int i = 0; i < WORLD_W * WORLD_H; i++) {
+        Uint32 a = sw.fb[i], b = readback[i];
+        if ((a & 0xFFFFFF) == (b & 0xFFFFFF)) continue;
+        differing++;
+        int delta = 0;
+        for (int shift = 0; shift < 24; shift += 8) {
+            int d = abs((int)((a >> shift) & 255) - (int)((b >> shift) & 255));
+            if (d > delta) delta = d;
+        }
+        if (delta > 8) beyond_tolerance++;
+        if (delta > max_delta) max_delta = delta;
+    }
+    printf("Software: %.2f ms (%d commands, %d threads) | %s: %.2f ms incl. readback\n",
+           sw_ms, sw.cmd_cnt, thread_pool.thread_cnt + 1, render_path_names[sdl_path], sdl_ms);
+    printf("  %ld of %d pixels differ (%.2f%%), %ld by more than 8 levels, max delta %d\n",
+           differing, WORLD_W * WORLD_H, 100.0 * differing / (WORLD_W * WORLD_H), beyond_tolerance, max_delta);
+    
+    SDL_DestroyTexture(target);
+    free(readback);
+    set_render_scale(saved_scale);
+}
+
+// Simulation thread. Each frame the main loop queues the ticks that are due
+// and then draws the newest snapshot while they run, so a frame costs about
+// max(sim, render) instead of their sum. With --no-sim-thread the ticks run
+// inline before drawing instead.
+bool use_sim_thread = true;
+SDL_Thread* sim_thread = NULL;
+SDL_sem* sim_wake = NULL;
+SDL_atomic_t sim_ticks_owed;
+SDL_atomic_t sim_quit;
+
+int sim_thread_main(void* data) {
+    for (;;) {
+        SDL_SemWait(sim_wake);
+        if (SDL_AtomicGet(&sim_quit)) break;
+        while (SDL_AtomicGet(&sim_ticks_owed) > 0) {
+            update();
+            snapshot_publish();
+            SDL_AtomicAdd(&sim_ticks_owed, -1);
+        }
+    }
+    return 0;
+}
+
+void sim_start() {
+    SDL_AtomicSet(&snapshot_spare, 2);
+    snapshot_publish();
+    snapshot_acquire();
+    if (!use_sim_thread) return;
+    sim_wake = SDL_CreateSemaphore(0);
+    sim_thread = SDL_CreateThread(sim_thread_main, "sim", NULL);
+    if (!sim_thread) {
+        fprintf(stderr, "Could not start the simulation thread, simulating inline: %s\n", SDL_GetError());
+        use_sim_thread = false;
+    }
+}
+
+// Queues ticks for the simulation and returns how many were accepted. The
+// backlog never exceeds MAX_TICKS_PER_FRAME; ticks beyond it are dropped.
+int sim_queue_ticks(int ticks) {
+    if (!use_sim_thread) {
+        for (int i = 0; i < ticks; i++) {
+            update();
+            snapshot_publish();
         }
+        return ticks;
     }
-    
-    if (frame % 520 == 0 && creature_cnt < 14 + (int)(danger_level * 12)) {
-        spawn_creature();
+    // Only this thread adds to the backlog, so it can only shrink meanwhile
+    int accepted = SDL_min(ticks, MAX_TICKS_PER_FRAME - SDL_AtomicGet(&sim_ticks_owed));
+    if (accepted <= 0) return 0;
+    SDL_AtomicAdd(&sim_ticks_owed, accepted);
+    SDL_SemPost(sim_wake);
+    return accepted;
+}
+
+void sim_stop() {
+    if (!sim_thread) return;
+    SDL_AtomicSet(&sim_quit, 1);
+    SDL_SemPost(sim_wake);
+    SDL_WaitThread(sim_thread, NULL);
+    SDL_DestroySemaphore(sim_wake);
+    sim_thread = NULL;
+}
+
+void loop_stats_report() {
+    LoopStats* st = &loop_stats;
+    printf("Loop: %llu frames, %llu sim ticks (%.2f ticks/frame), %llu missed deadlines (%llu ticks dropped), %llu sleeps\n",
+           (unsigned long long)st->frames, (unsigned long long)st->ticks,
+           st->frames ? (double)st->ticks / st->frames : 0.0,
+           (unsigned long long)st->missed_deadlines, (unsigned long long)st->dropped_ticks,
+           (unsigned long long)st->sleeps);
+    printf("  ticks/frame histogram:");
+    for (int i = 0; i <= MAX_TICKS_PER_FRAME; i++) printf(" %d:%llu", i, (unsigned long long)st->ticks_per_frame[i]);
+    printf("\n");
+}
+
+// Capacity options, set with --<key> N on the command line or "key = N"
+// lines in a --config file
+typedef struct {
+    const char* key;
+    int* value;
+} CapacityOption;
+
+CapacityOption capacity_options[] = {
+    {"max-clouds", &caps.max_clouds},
+    {"max-creatures", &caps.max_creatures},
+    {"max-particles", &caps.max_particles},
+    {"stars", &caps.stars_per_screen},
+    {"debris", &caps.debris_per_screen},
+};
+
+CapacityOption* find_capacity(const char* key) {
+    for (int i = 0; i < (int)SDL_arraysize(capacity_options); i++) {
+        if (strcmp(key, capacity_options[i].key) == 0) return &capacity_options[i];
     }
-    
-    for (int i = particle_cnt - 1; i >= 0; i--) {
-        Particle* p = &particles[i];
-        p->x += p->vx;
-        p->y += p->vy;
-        p->vy += 0.06f * ((p->color >> 24) / 255.0f);
-        p->vx *= 0.98f;
-        p->life -= 1.2f;
-        if (p->life <= 0) {
-            particles[i] = particles[--particle_cnt];
-        } else {
-            wrap(&p->x, &p->y);
-        }
+    return NULL;
+}
+
+// Returns false, leaving the capacity alone, if key is not a capacity option
+// or value is not a whole number. Values are clamped to [0, MAX_CAPACITY].
+bool set_capacity(const char* key, const char* value) {
+    CapacityOption* opt = find_capacity(key);
+    char* rest;
+    long v = strtol(value, &rest, 10);
+    if (!opt || rest == value || *rest) return false;
+    *opt->value = v < 0 ? 0 : v > MAX_CAPACITY ? MAX_CAPACITY : (int)v;
+    return true;
+}
+
+bool load_config(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    char line[256], key[64], value[64];
+    int lineno = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        if (sscanf(line, " %63[^=# \t\r\n] = %63s", key, value) != 2) continue;
+        if (set_capacity(key, value)) continue;
+        if (find_capacity(key)) fprintf(stderr, "%s:%d: '%s' is not a number\n", path, lineno, value);
+        else fprintf(stderr, "%s:%d: unknown option '%s'\n", path, lineno, key);
+        ok = false;
     }
+    fclose(f);
+    return ok;
+}
+
+// Carves every entity pool from a; with an empty arena this just measures.
+// Carves a world's pools as one block. Without cosmetics the particle pool
+// gets no room, since nothing would ever be spawned into it.
+void world_carve(World* w, Arena* a) {
+    w->state = arena_alloc(a, 0);
+    size_t start = a->used;
+    cloud_store_init(&w->clouds, a, caps.max_clouds);
+    entity_ids_init(&w->clouds.ids, a, caps.max_clouds);
+    creature_store_init(&w->creatures, a, caps.max_creatures);
+    entity_ids_init(&w->creatures.ids, a, caps.max_creatures);
+    int particles = w->cosmetics ? caps.max_particles : 0;
+    particle_pool_init(&w->particles, a, particles, particle_slots(particles));
+    grid_init(&w->cloud_grid, a, caps.max_clouds);
+    grid_init(&w->creature_grid, a, caps.max_creatures);
+    w->grid_query_buf = arena_alloc(a, SDL_max(caps.max_clouds, caps.max_creatures) * sizeof(int));
+    grid_moves_init(&w->cloud_moves, a, caps.max_clouds, SIM_CHUNK);
+    grid_moves_init(&w->creature_moves, a, caps.max_creatures, SIM_CHUNK);
+    w->state_size = a->used - start;
+}
+
+// The render-side buffers go after the main world's state, which world_reset
+// may clear while the render thread is still reading them
+void render_carve(Arena* a) {
+    particle_renderer_init(&particle_renderer, a, caps.max_particles);
+    for (int i = 0; i < 3; i++) snapshot_init(&snapshots[i], a);
+    field_stars = arena_alloc(a, FIELD_VIEW_TILES * field_tile_max(caps.stars_per_screen) * sizeof(Star));
+    field_debris = arena_alloc(a, FIELD_VIEW_TILES * field_tile_max(caps.debris_per_screen) * sizeof(Debris));
+    int scenery = FIELD_VIEW_TILES * field_tile_max(SDL_max(caps.stars_per_screen, caps.debris_per_screen));
+    trig_x = arena_alloc(a, scenery * sizeof(float));
+    trig_arg = arena_alloc(a, scenery * sizeof(float));
+    trig_sin = arena_alloc(a, scenery * sizeof(float));
+    trig_cos = arena_alloc(a, scenery * sizeof(float));
+}
+
+bool world_init() {
+    Arena measure = {0};
+    world_carve(&main_world, &measure);
+    render_carve(&measure);
+    if (!arena_create(&world_arena, measure.used)) return false;
+    world_carve(&main_world, &world_arena);
+    render_carve(&world_arena);
+    printf("World arena: %.1f KB used of %.1f KB%s (clouds %d, creatures %d, particles %d, stars %d/screen, debris %d/screen)\n",
+           world_arena.used / 1024.0, world_arena.size / 1024.0, world_arena.huge ? ", huge pages" : "",
+           caps.max_clouds, caps.max_creatures, caps.max_particles, caps.stars_per_screen, caps.debris_per_screen);
+    return true;
+}
+
+// Headless entry point: runs the simulation for `ticks` ticks with no window
+// or renderer, as fast as the CPU allows, and returns the achieved ticks/sec.
+// Input comes from input_source (the autopilot unless a script or a
+// recording was loaded).
+double run_headless(long ticks, Uint64 seed) {
+    if (world->input_source == keyboard_input) world->input_source = autopilot_input;
+    rng_seed_all(seed);
+    init_game();
+    world->game_overs = 0;
     
-    if (combo_timer > 0) combo_timer--;
-    else ship.combo = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (long t = 0; t < ticks; t++) update();
+    double secs = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    double tps = secs > 0 ? ticks / secs : 0.0;
     
-    if (wave_flash_timer > 0) wave_flash_timer--;
-    if (current_wave_display_timer > 0) current_wave_display_timer--;
+    printf("Headless: %ld ticks in %.3f s = %.0f ticks/s (%.1fx real time), seed %llu\n",
+           ticks, secs, tps, tps / SIM_HZ, (unsigned long long)seed);
+    printf("  wave %d, score %d, danger %.2f, %d clouds, %d creatures, %d particles, %d game overs\n",
+           world->wave, world->ship.score, world->danger_level, world->clouds.count, world->creatures.count,
+           world->particles.count, world->game_overs);
+    printf("  %d sim threads, state hash %016llx\n", sim_pool.thread_cnt + 1, (unsigned long long)world_hash());
+    particle_budget_report();
+    return tps;
 }
 
-void draw_ship() {
-    float heat_ratio = ship.heat / (float)OVERHEAT_MAX;
-    float heat_glow = fminf(heat_ratio, 1.3f);
+// Batched simulation: many independent worlds advanced one tick at a time,
+// as when an agent is trained or evaluated on thousands of games at once.
+// Each world's struct and pools are carved back to back, so a worker
+// stepping a world stays within one block of memory. What gets exchanged
+// with all worlds every tick (input, score, lives, wave) is kept in
+// per-field arrays across the worlds instead, so it can be filled and read
+// in bulk.
+typedef struct {
+    Arena mem;
+    int count;
+    World** worlds;
+    Uint8* input;     // per world, read by worlds whose input_source is batch_input
+    int* score;       // per world, as of the last step
+    int* lives;
+    int* wave;
+    Uint64 steps;
+} WorldBatch;
 
-    Uint8 r = 255;
-    Uint8 g = (Uint8)(255 - heat_glow * 160);
-    Uint8 b = (Uint8)(120 + heat_glow * 40);
-    Uint8 alpha = 220 + (Uint8)(35 * sinf(frame * 0.25f));
+Uint8 batch_input() {
+    return world->batch_input;
+}
 
-    if (is_critical_overheat()) {
-        if ((frame / 5) % 2 == 0) {
-            r = 255; g = 50; b = 30;
-            alpha = 255;
-        } else {
-            r = 230; g = 90; b = 50;
-            alpha = 200;
+void world_batch_observe(WorldBatch* b, int i) {
+    const World* w = b->worlds[i];
+    b->score[i] = w->ship.score;
+    b->lives[i] = w->ship.lives;
+    b->wave[i] = w->wave;
+}
+
+// Carves and starts count worlds, world i from seed + i. They fly on the
+// autopilot until their input_source is set to batch_input.
+bool world_batch_init(WorldBatch* b, int count, Uint64 seed, bool cosmetics) {
+    *b = (WorldBatch){.count = count};
+    Arena measure = {0};
+    World probe = {.cosmetics = cosmetics};
+    for (int pass = 0; pass < 2; pass++) {
+        Arena* a = pass ? &b->mem : &measure;
+        b->worlds = arena_alloc(a, count * sizeof(World*));
+        b->input = arena_alloc(a, count);
+        b->score = arena_alloc(a, count * sizeof(int));
+        b->lives = arena_alloc(a, count * sizeof(int));
+        b->wave = arena_alloc(a, count * sizeof(int));
+        for (int i = 0; i < count; i++) {
+            World* w = arena_alloc(a, sizeof(World));
+            if (!pass) {
+                world_carve(&probe, a);
+                continue;
+            }
+            *w = (World){.input_source = autopilot_input, .cosmetics = cosmetics, .batched = true};
+            world_carve(w, a);
+            b->worlds[i] = w;
         }
-    } else if (is_overheat_warning()) {
-        g = (Uint8)(g * 0.5f + 100);
-        b = (Uint8)(b * 0.3f + 30);
+        if (!pass && !arena_create(&b->mem, measure.used)) return false;
+    }
+    World* saved = world;
+    for (int i = 0; i < count; i++) {
+        world = b->worlds[i];
+        rng_seed_all(seed + i);
+        init_game();
+        world_batch_observe(b, i);
     }
+    world = saved;
+    return true;
+}
 
-    SDL_SetRenderDrawColor(renderer, r, g, b, alpha);
-    
-    float nx = ship.x + cosf(ship.angle) * 30;
-    float ny = ship.y + sinf(ship.angle) * 30;
-    float lx = ship.x + cosf(ship.angle + 2.4f) * 24;
-    float ly = ship.y + sinf(ship.angle + 2.4f) * 24;
-    float rx = ship.x + cosf(ship.angle - 2.4f) * 24;
-    float ry = ship.y + sinf(ship.angle - 2.4f) * 24;
-    float corex = ship.x + cosf(ship.angle) * 14;
-    float corey = ship.y + sinf(ship.angle) * 14;
-    
-    thick_line((int)nx, (int)ny, (int)lx, (int)ly, 7);
-    thick_line((int)lx, (int)ly, (int)corex, (int)corey, 7);
-    thick_line((int)corex, (int)corey, (int)rx, (int)ry, 7);
-    thick_line((int)rx, (int)ry, (int)nx, (int)ny, 7);
-    
-    SDL_SetRenderDrawColor(renderer, 255, 240 - (int)(heat_glow * 120), 180, 200);
-    for (int r = 0; r < 12; r++) {
-        SDL_RenderDrawLine(renderer, (int)(ship.x - r), (int)ship.y, (int)(ship.x + r), (int)ship.y);
-        SDL_RenderDrawLine(renderer, (int)ship.x, (int)(ship.y - r), (int)ship.x, (int)(ship.y + r));
+void world_batch_task(void* ctx, int i) {
+    WorldBatch* b = ctx;
+    world = b->worlds[i];
+    world->batch_input = b->input[i];
+    update();
+    world_batch_observe(b, i);
+}
+
+// Advances every world of the batch by one tick. The worlds are spread over
+// sim_pool and each runs its own passes inline; no two tasks share any
+// mutable state, so the outcome does not depend on the thread count.
+void world_batch_step(WorldBatch* b) {
+    World* saved = world;
+    PROF_PAUSE(true);
+    pool_run(&sim_pool, world_batch_task, b, b->count);
+    PROF_PAUSE(false);
+    world = saved;
+    b->steps++;
+}
+
+Uint64 world_batch_hash(WorldBatch* b) {
+    World* saved = world;
+    Uint64 h = 0xCBF29CE484222325ull;
+    for (int i = 0; i < b->count; i++) {
+        world = b->worlds[i];
+        Uint64 wh = world_hash();
+        h = hash_bytes(h, &wh, sizeof(wh));
     }
-    
-    if (ship.tractor_active) {
-        float pulse = sinf(frame * 0.3f) * 0.4f + 0.6f;
-        Uint8 beam_a = (Uint8)(180 + 75 * pulse);
-        SDL_SetRenderDrawColor(renderer, 120, 240, 255, beam_a);
-        for (int r = 0; r < 16; r += 3) {
-            SDL_RenderDrawLine(renderer, (int)(ship.x - r*1.4f), (int)ship.y, 
-                                     (int)(ship.x + r*1.4f), (int)ship.y);
-        }
+    world = saved;
+    return h;
+}
+
+// Headless batch entry point (--worlds N): steps N worlds on the autopilot
+// for `ticks` ticks each and returns the aggregate world-ticks/sec
+double run_worlds(int count, long ticks, Uint64 seed, bool cosmetics) {
+    WorldBatch batch;
+    if (!world_batch_init(&batch, count, seed, cosmetics)) {
+        fprintf(stderr, "Out of memory for %d worlds\n", count);
+        return 0.0;
     }
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (long t = 0; t < ticks; t++) world_batch_step(&batch);
+    double secs = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    double wtps = secs > 0 ? (double)count * ticks / secs : 0.0;
     
-    if (ship.combo > 0) {
-        float pulse = sinf(frame * 0.25f) * 0.5f + 0.5f;
-        Uint8 aura_a = (Uint8)(140 + 115 * pulse);
-        SDL_SetRenderDrawColor(renderer, 140, 255, 220, aura_a);
-        for (int r = 0; r < 14; r += 2) {
-            SDL_RenderDrawLine(renderer, (int)(ship.x - r), (int)(ship.y - r), 
-                                     (int)(ship.x + r), (int)(ship.y - r));
-            SDL_RenderDrawLine(renderer, (int)(ship.x - r), (int)(ship.y + r), 
-                                     (int)(ship.x + r), (int)(ship.y + r));
-        }
+    long long score = 0, game_overs = 0, waves = 0;
+    for (int i = 0; i < count; i++) {
+        score += batch.score[i];
+        waves += batch.wave[i];
+        game_overs += batch.worlds[i]->game_overs;
     }
+    printf("Worlds: %d x %ld ticks in %.3f s = %.0f world-ticks/s (%.1fx real time per world), seeds %llu+\n",
+           count, ticks, secs, wtps, wtps / count / SIM_HZ, (unsigned long long)seed);
+    printf("  mean wave %.2f, mean score %.0f, %lld game overs, cosmetics %s\n",
+           (double)waves / count, (double)score / count, game_overs, cosmetics ? "on" : "off");
+    printf("  %d sim threads, %.1f KB per world, batch hash %016llx\n", sim_pool.thread_cnt + 1,
+           batch.mem.used / 1024.0 / count, (unsigned long long)world_batch_hash(&batch));
+    arena_destroy(&batch.mem);
+    return wtps;
+}
 
-    if (is_overheat_warning()) {
-        Uint8 glow_a = (Uint8)(80 + 120 * sinf(frame * 0.45f));
-        SDL_SetRenderDrawColor(renderer, 255, 140, 40, glow_a);
-        for (int r = 0; r < 22; r += 4) {
-            SDL_RenderDrawLine(renderer, (int)(ship.x - r*1.6f), (int)ship.y,
-                                     (int)(ship.x + r*1.6f), (int)ship.y);
+// Microbenchmark: integrates a pool of n particles with the scalar and the
+// SIMD kernel from the same start state, checks they agree, then times
+// stream compaction.
+void bench_particles(int n) {
+    ParticlePool pools[2];
+    Arena arena = {0};
+    particle_pool_init(&pools[0], &arena, n, n);
+    particle_pool_init(&pools[1], &arena, n, n);
+    if (!arena_create(&arena, arena.used)) {
+        fprintf(stderr, "Could not allocate %d particles\n", n);
+        return;
+    }
+    particle_pool_init(&pools[0], &arena, n, n);
+    particle_pool_init(&pools[1], &arena, n, n);
+    for (int k = 0; k < 2; k++) {
+        rng_seed_all(1);
+        for (int i = 0; i < n; i++) {
+            particle_pool_spawn(&pools[k], 0, rng_float(RNG_FX) * WORLD_W, rng_float(RNG_FX) * WORLD_H,
+                                rng_float(RNG_FX) * 16 - 8, rng_float(RNG_FX) * 16 - 8,
+                                0x00FFFFFF | (rng_next(RNG_FX) << 24), 1e9f);
         }
     }
-}
-
-void draw_gas_cloud(GasCloud* c) {
-    float pulse = 0.8f + 0.2f * sinf(c->phase + frame * 0.14f);
-    int rad = (int)(c->size * pulse * c->density);
     
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 50);
-    for (int dy = -rad*1.3f; dy <= rad*1.3f; dy += 7) {
-        int w = (int)(sqrtf(rad*rad*1.7f - dy*dy) * 0.35f);
-        if (w > 0)
-            SDL_RenderDrawLine(renderer, (int)(c->x - w), (int)(c->y + dy), (int)(c->x + w), (int)(c->y + dy));
+    int iters = n >= 100000 ? 200 : 2000;
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    for (int k = 0; k < 2; k++) {
+        ParticlePool* p = &pools[k];
+        Uint64 t0 = SDL_GetPerformanceCounter();
+        for (int it = 0; it < iters; it++) {
+            if (k == 0) particles_integrate_scalar(p, 0, p->count);
+            else particles_integrate(p, 0, p->count);
+        }
+        double ns = (double)(SDL_GetPerformanceCounter() - t0) * 1e9 / freq / ((double)iters * n);
+        printf("%-6s integrate: %d particles x %d ticks, %.3f ns/particle\n",
+               k ? "simd" : "scalar", n, iters, ns);
     }
     
-    SDL_SetRenderDrawColor(renderer, (c->color>>16)&255, (c->color>>8)&255, c->color&255, 255);
-    for (int dy = -rad; dy <= rad; dy += 3) {
-        int w = (int)(sqrtf(rad*rad - dy*dy) * c->density * 0.9f);
-        SDL_RenderDrawLine(renderer, (int)(c->x - w), (int)(c->y + dy), (int)(c->x + w), (int)(c->y + dy));
+    float max_err = 0;
+    for (int i = 0; i < n; i++) {
+        max_err = fmaxf(max_err, fabsf(pools[0].x[i] - pools[1].x[i]));
+        max_err = fmaxf(max_err, fabsf(pools[0].y[i] - pools[1].y[i]));
     }
+    printf("max position difference scalar vs simd: %g\n", max_err);
     
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 220);
-    for (int r = 0; r < 8; r++) {
-        SDL_RenderDrawLine(renderer, (int)(c->x - r), (int)c->y, (int)(c->x + r), (int)c->y);
-        SDL_RenderDrawLine(renderer, (int)c->x, (int)(c->y - r), (int)c->x, (int)(c->y + r));
-    }
+    ParticlePool* p = &pools[1];
+    for (int i = 0; i < n; i++) p->life[i] = (i % 50 == 0) ? -1.0f : 1.0f;
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    particles_compact(p);
+    double ns = (double)(SDL_GetPerformanceCounter() - t0) * 1e9 / freq / n;
+    printf("compact: %d -> %d particles, %.3f ns/particle\n", n, p->count, ns);
+    
+    arena_destroy(&arena);
 }
 
-void draw_nebula_creature(NebulaCreature* n) {
-    float pulse = 0.85f + 0.15f * sinf(frame * 0.18f + n->hunt_phase);
-    int size = (int)(n->size * pulse);
-    
-    SDL_SetRenderDrawColor(renderer, (n->color>>16)&255, (n->color>>8)&255, n->color&255, (n->color>>24)&255);
-    for (int dy = -size; dy <= size; dy += 3) {
-        int w = (int)sqrtf(size*size - dy*dy);
-        SDL_RenderDrawLine(renderer, (int)(n->x - w), (int)(n->y + dy), (int)(n->x + w), (int)(n->y + dy));
+// Checks the fast math functions against double-precision libm over a
+// spread of inputs, and that the array kernels match the scalar versions bit
+// for bit; then times both against the libm calls they replace. Returns
+// false if any error bound is exceeded.
+bool bench_math() {
+    enum { N = 1 << 16, ITERS = 200 };
+    float* in_a = malloc(N * sizeof(float));
+    float* in_b = malloc(N * sizeof(float));
+    float* out_a = malloc(N * sizeof(float));
+    float* out_b = malloc(N * sizeof(float));
+    if (!in_a || !in_b || !out_a || !out_b) {
+        free(in_a); free(in_b); free(out_a); free(out_b);
+        fprintf(stderr, "Out of memory\n");
+        return false;
     }
+    bool ok = true;
+    rng_seed_all(1);
     
-    if (n->type == 0) {
-        SDL_SetRenderDrawColor(renderer, 200, 220, 255, 180);
-        for (int i = 0; i < 5; i++) {
-            float ang = n->angle + i * M_PI / 2.5f + sinf(n->wiggle + i) * 0.3f;
-            int ex = (int)(n->x + cosf(ang) * (size + 10));
-            int ey = (int)(n->y + sinf(ang) * (size + 10));
-            thick_line((int)n->x, (int)n->y, ex, ey, 2);
-        }
-    } else if (n->type == 1) {
-        SDL_SetRenderDrawColor(renderer, 255, 120, 120, 220);
-        for (int i = 0; i < 6; i++) {
-            float ang = n->angle + i * M_PI / 3 + sinf(n->wiggle + i) * 0.4f;
-            int ex = (int)(n->x + cosf(ang) * (size + 16));
-            int ey = (int)(n->y + sinf(ang) * (size + 16));
-            thick_line((int)n->x, (int)n->y, ex, ey, 4);
-        }
-    } else {
-        SDL_SetRenderDrawColor(renderer, 180, 100, 220, 200);
-        for (int i = 0; i < 8; i++) {
-            float ang = n->angle + i * M_PI / 4 + sinf(n->wiggle * 0.8f + i) * 0.6f;
-            int ex = (int)(n->x + cosf(ang) * (size + 18));
-            int ey = (int)(n->y + sinf(ang) * (size + 18));
-            thick_line((int)n->x, (int)n->y, ex, ey, 3);
+    struct { const char* name; float range, bound; } sincos_cases[] = {
+        {"fast_sincos |x|<=1e3", 1e3f, SINCOS_MAX_ERR},
+        {"fast_sincos |x|<=1e5", 1e5f, SINCOS_MAX_ERR_WIDE},
+    };
+    for (int k = 0; k < (int)SDL_arraysize(sincos_cases); k++) {
+        for (int i = 0; i < N; i++) in_a[i] = (rng_float(RNG_FX) * 2 - 1) * sincos_cases[k].range;
+        fast_sincos_array(in_a, out_a, out_b, N);
+        double err = 0;
+        int mismatches = 0;
+        for (int i = 0; i < N; i++) {
+            float s, c;
+            fast_sincos(in_a[i], &s, &c);
+            if (s != out_a[i] || c != out_b[i]) mismatches++;
+            err = fmax(err, fmax(fabs(s - sin(in_a[i])), fabs(c - cos(in_a[i]))));
         }
+        bool pass = err <= sincos_cases[k].bound && mismatches == 0;
+        printf("%-22s max abs error %.3g (bound %.3g), %d array mismatches: %s\n",
+               sincos_cases[k].name, err, sincos_cases[k].bound, mismatches, pass ? "ok" : "FAIL");
+        ok &= pass;
     }
     
-    float dist_to_ship = distance(n->x, n->y, ship.x, ship.y);
-    if (dist_to_ship < CREATURE_DANGER_DIST) {
-        Uint8 glow = (Uint8)(255 * (1.0f - dist_to_ship / CREATURE_DANGER_DIST));
-        SDL_SetRenderDrawColor(renderer, 255, 80, 80, glow);
-        for (int r = 0; r < 20; r += 4) {
-            SDL_RenderDrawLine(renderer, (int)(n->x - r), (int)n->y, (int)(n->x + r), (int)n->y);
-        }
+    for (int i = 0; i < N; i++) {
+        in_a[i] = (rng_float(RNG_FX) * 2 - 1) * 1000;
+        in_b[i] = (rng_float(RNG_FX) * 2 - 1) * 1000;
+        if (i % 97 == 0) in_a[i] = 0;
+        if (i % 89 == 0) in_b[i] = 0;
     }
-}
-
-void draw_nebula(Nebula* n) {
-    float nx = n->x - scrollX * 0.08f;
-    if (nx < -400 || nx > WINDOW_W + 400) return;
+    fast_atan2_array(in_a, in_b, out_a, N);
+    double err = 0;
+    int mismatches = 0;
+    for (int i = 0; i < N; i++) {
+        float r = fast_atan2(in_a[i], in_b[i]);
+        if (r != out_a[i]) mismatches++;
+        if (in_a[i] != 0 || in_b[i] != 0) err = fmax(err, fabs(r - atan2(in_a[i], in_b[i])));
+    }
+    bool pass = err <= ATAN2_MAX_ERR && mismatches == 0;
+    printf("%-22s max abs error %.3g (bound %.3g), %d array mismatches: %s\n",
+           "fast_atan2", err, ATAN2_MAX_ERR, mismatches, pass ? "ok" : "FAIL");
+    ok &= pass;
     
-    n->swirl += 0.003f;
-    n->pulse += 0.012f;
+    for (int i = 0; i < N; i++) in_a[i] = expf((rng_float(RNG_FX) * 2 - 1) * 80);
+    fast_rsqrt_array(in_a, out_a, N);
+    err = 0;
+    mismatches = 0;
+    for (int i = 0; i < N; i++) {
+        float r = fast_rsqrt(in_a[i]);
+        if (r != out_a[i]) mismatches++;
+        err = fmax(err, fabs(r * sqrt(in_a[i]) - 1));
+    }
+    pass = err <= RSQRT_MAX_ERR && mismatches == 0;
+    printf("%-22s max rel error %.3g (bound %.3g), %d array mismatches: %s\n",
+           "fast_rsqrt", err, RSQRT_MAX_ERR, mismatches, pass ? "ok" : "FAIL");
+    ok &= pass;
     
-    float brightness_pulse = 0.9f + 0.1f * sinf(n->pulse);
-    Uint8 alpha_base = (Uint8)(0x88 * brightness_pulse);
+    for (int i = 0; i < N; i++) in_a[i] = (rng_float(RNG_FX) * 2 - 1) * 5 * WORLD_W;
+    mismatches = 0;
+    for (int i = 0; i < N; i++) {
+        float r = fast_wrap(in_a[i], WORLD_W, 1.0f / WORLD_W);
+        double ref = fmod(fmod((double)in_a[i], WORLD_W) + WORLD_W, WORLD_W);
+        double d = fabs(r - ref);
+        if (!(r >= 0 && r < WORLD_W) || fmin(d, WORLD_W - d) > 1e-3) mismatches++;
+    }
+    printf("%-22s %d results outside [0, period) or off by more than 1e-3: %s\n", "fast_wrap", mismatches, mismatches ? "FAIL" : "ok");
+    ok &= mismatches == 0;
     
-    int r = (int)n->radius;
-    SDL_SetRenderDrawColor(renderer, (n->color>>16)&255, (n->color>>8)&255, n->color&255, alpha_base);
-    for (int dy = -r; dy <= r; dy += 5) {
-        float swirl_off = sinf((dy * 0.025f + n->swirl * 3) * 1.7f) * n->density * 35;
-        int hw = (int)(sqrtf(r*r - dy*dy) + swirl_off);
-        SDL_RenderDrawLine(renderer, (int)(nx - hw), (int)(n->y + dy), (int)(nx + hw), (int)(n->y + dy));
+    // Timings, in ns per element
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    volatile float sink = 0;
+    for (int i = 0; i < N; i++) {
+        in_a[i] = (rng_float(RNG_FX) * 2 - 1) * 100;
+        in_b[i] = (rng_float(RNG_FX) * 2 - 1) * 100;
     }
+#define BENCH(label, body) do { \
+        Uint64 t0 = SDL_GetPerformanceCounter(); \
+        for (int it = 0; it < ITERS; it++) { body; } \
+        double ns = (double)(SDL_GetPerformanceCounter() - t0) * 1e9 / freq / ((double)ITERS * N); \
+        sink += out_a[N / 2] + out_b[N / 2]; \
+        printf("  %-28s %6.2f ns\n", label, ns); \
+    } while (0)
+    printf("Timings (ns per element):\n");
+    BENCH("libm sinf + cosf", for (int i = 0; i < N; i++) { out_a[i] = sinf(in_a[i]); out_b[i] = cosf(in_a[i]); });
+    BENCH("fast_sincos", for (int i = 0; i < N; i++) fast_sincos(in_a[i], &out_a[i], &out_b[i]));
+    BENCH("fast_sincos_array", fast_sincos_array(in_a, out_a, out_b, N));
+    BENCH("libm atan2f", for (int i = 0; i < N; i++) out_a[i] = atan2f(in_a[i], in_b[i]));
+    BENCH("fast_atan2", for (int i = 0; i < N; i++) out_a[i] = fast_atan2(in_a[i], in_b[i]));
+    BENCH("fast_atan2_array", fast_atan2_array(in_a, in_b, out_a, N));
+    for (int i = 0; i < N; i++) in_b[i] = fabsf(in_b[i]) + 0.01f;
+    BENCH("1 / sqrtf", for (int i = 0; i < N; i++) out_a[i] = 1.0f / sqrtf(in_b[i]));
+    BENCH("fast_rsqrt", for (int i = 0; i < N; i++) out_a[i] = fast_rsqrt(in_b[i]));
+    BENCH("fast_rsqrt_array", fast_rsqrt_array(in_b, out_a, N));
+    BENCH("libm hypotf", for (int i = 0; i < N; i++) out_a[i] = hypotf(in_a[i], in_b[i]));
+    BENCH("fast_hypot", for (int i = 0; i < N; i++) out_a[i] = fast_hypot(in_a[i], in_b[i]));
+    BENCH("fmodf wrap", for (int i = 0; i < N; i++) out_a[i] = fmodf(in_a[i] * 50 + WORLD_W * 10, WORLD_W));
+    BENCH("fast_wrap", for (int i = 0; i < N; i++) out_a[i] = fast_wrap(in_a[i] * 50, WORLD_W, 1.0f / WORLD_W));
+#undef BENCH
+    (void)sink;
     
-    // Very subtle core
-    SDL_SetRenderDrawColor(renderer, 180, 190, 255, (Uint8)(70 * brightness_pulse));
-    for (int dy = -r/4; dy <= r/4; dy += 10) {
-        int hw = (int)(sqrtf((r/4)*(r/4) - dy*dy) * 1.2f);
-        SDL_RenderDrawLine(renderer, (int)(nx - hw), (int)(n->y + dy), (int)(nx + hw), (int)(n->y + dy));
+    free(in_a); free(in_b); free(out_a); free(out_b);
+    printf("Fast math: %s\n", ok ? "all bounds hold" : "BOUNDS EXCEEDED");
+    return ok;
+}
+
+// Scenario benchmark (--bench): drives the real update() and render() through
+// scripted situations and reports p50/p95/p99/max milliseconds per phase.
+// Each frame is one tick simulated inline followed by one render, so the two
+// are timed separately; the phases inside them come from the profiler when it
+// is built in. Every scenario starts from the same seed.
+#define BENCH_SEED      1
+#define BENCH_WARMUP    120     // ticks before sampling starts
+#define BENCH_NOISE_MS  0.02    // slowdowns smaller than this are never regressions
+#define BENCH_MAX_RESULTS 256
+
+typedef struct {
+    const char* name;
+    void (*setup)();
+    void (*step)();   // before every tick, to hold the situation in place
+    Uint8 (*input)();
+} BenchScenario;
+
+typedef struct {
+    char scenario[32], phase[32];
+    int samples;
+    double p50, p95, p99, max;
+} BenchResult;
+
+BenchResult bench_results[BENCH_MAX_RESULTS];
+int bench_result_cnt = 0;
+int bench_swarm_size = 0;
+
+Uint8 bench_tractor_input() { return INPUT_TRACTOR; }
+Uint8 bench_overheat_input() { return INPUT_THRUST | INPUT_LEFT; }
+
+void bench_max_danger() {
+    world->danger_level = 1.3f;   // the cap; 85 clouds at the default capacities
+}
+
+// Pulls every cloud outside the beam back into it, so the tractor always has
+// a full field to work on and harvests keep happening
+void bench_gather_clouds() {
+    bench_max_danger();
+    world->ship.lives = 3;
+    for (int i = 0; i < world->clouds.count; i++) {
+        Motion* c = &world->clouds.motion[i];
+        if (distance_sq(c->x, c->y, world->ship.x, world->ship.y) < TRACTOR_RANGE * TRACTOR_RANGE) continue;
+        float ang = rng_float(RNG_GAMEPLAY) * 2 * M_PI;
+        float r = HARVEST_RANGE + 20 + rng_float(RNG_GAMEPLAY) * (TRACTOR_RANGE - HARVEST_RANGE - 30);
+        c->x = world->ship.x + fast_cos(ang) * r;
+        c->y = world->ship.y + fast_sin(ang) * r;
+        wrap(&c->x, &c->y);
+        world->clouds.prev[i] = (SDL_FPoint){c->x, c->y};
+        grid_update(&world->cloud_grid, i, c->x, c->y);
     }
 }
 
-void render() {
-    SDL_SetRenderDrawColor(renderer, 3, 3, 12, 255);
-    SDL_RenderClear(renderer);
-    
-    for (int i = 0; i < NUM_STARS; i++) {
-        float px = stars[i].base_x - scrollX * 0.18f;
-        px = fmodf(px + 120000, 240000) - 120000;
-        if (px < -60 || px > WINDOW_W + 60) continue;
-        float twinkle = 0.65f + 0.35f * sinf(frame * 0.09f + stars[i].phase);
-        int br = (int)(stars[i].brightness * twinkle);
-        SDL_SetRenderDrawColor(renderer, br, br, br + 40, 255);
-        int sx = (int)px, sy = (int)stars[i].base_y;
-        for (int s = -stars[i].size; s <= stars[i].size; s++) {
-            SDL_RenderDrawPoint(renderer, sx + s, sy);
-            SDL_RenderDrawPoint(renderer, sx, sy + s);
+void bench_overheat() {
+    world->ship.heat = OVERHEAT_MAX;
+    world->ship.lives = 3;
+}
+
+// Harvest bursts all over the screen until the pool is full
+void bench_flood_particles() {
+    particle_budget_begin_tick();
+    for (int k = 0; k < 8 && world->particles.count < world->particles.capacity; k++) {
+        harvest_effect(rng_float(RNG_FX) * WORLD_W, rng_float(RNG_FX) * WORLD_H, 10);
+    }
+}
+
+// Plays through the creature bonuses of ten wave advances
+void bench_swarm_setup() {
+    for (int k = 0; k < 10; k++) {
+        world->wave++;
+        for (int j = 0; j < WAVE_CREATURE_BONUS + world->wave / 2; j++) spawn_creature();
+    }
+    bench_swarm_size = world->creatures.count;
+}
+
+void bench_swarm_step() {
+    world->ship.lives = 3;
+    while (world->creatures.count < bench_swarm_size) spawn_creature();
+}
+
+BenchScenario bench_scenarios[] = {
+    {"wave1", NULL, NULL, autopilot_input},
+    {"danger", bench_max_danger, bench_max_danger, autopilot_input},
+    {"tractor", bench_gather_clouds, bench_gather_clouds, bench_tractor_input},
+    {"overheat", bench_overheat, bench_overheat, bench_overheat_input},
+    {"particles", bench_flood_particles, bench_flood_particles, autopilot_input},
+    {"swarm", bench_swarm_setup, bench_swarm_step, autopilot_input},
+};
+
+int compare_floats(const void* a, const void* b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+double percentile(const float* sorted, int n, double p) {
+    int rank = (int)ceil(p * n);
+    return sorted[SDL_max(rank, 1) - 1];
+}
+
+#ifndef HARVESTER_NO_PROFILER
+// Adds the profiler events logged since the last call to ms, per phase
+void bench_collect(Uint32 seen[PROF_TRACK_COUNT], float* ms) {
+    double to_ms = 1000.0 / SDL_GetPerformanceFrequency();
+    for (int t = 0; t < PROF_TRACK_COUNT; t++) {
+        Uint32 head = (Uint32)SDL_AtomicGet(&prof_tracks[t].head);
+        int n = prof_read(t, (int)SDL_min(head - seen[t], (Uint32)PROF_RING));
+        seen[t] = head;
+        for (int i = 0; i < n; i++) {
+            const ProfEvent* e = &prof_scratch[i];
+            ms[e->phase] += (float)((e->end - e->start) * to_ms);
         }
     }
+}
+#endif
+
+void bench_scenario(const BenchScenario* s, int frames, float* samples) {
+    rng_seed_all(BENCH_SEED);
+    init_game();
+    world->game_overs = 0;
+    world->prev_tractor = false;
+    world->input_source = s->input;
+    if (s->setup) s->setup();
     
-    for (int i = 0; i < NUM_DEBRIS; i++) {
-        float px = debris[i].base_x - scrollX * 0.45f;
-        px = fmodf(px + 180000, 360000) - 180000;
-        if (px < -40 || px > WINDOW_W + 40) continue;
-        int g = 100 + (int)(debris[i].vx * 180 + sinf(frame * 0.06f + i * 0.1f) * 35);
-        SDL_SetRenderDrawColor(renderer, g, g + 20, 180, 200);
-        for(int s = 0; s < debris[i].size * 2 + 1; s++) {
-            SDL_RenderDrawPoint(renderer, (int)px + s, (int)debris[i].base_y);
+    bool seen[PROF_PHASE_COUNT] = {false};
+    double to_ms = 1000.0 / SDL_GetPerformanceFrequency();
+#ifndef HARVESTER_NO_PROFILER
+    Uint32 heads[PROF_TRACK_COUNT];
+    for (int t = 0; t < PROF_TRACK_COUNT; t++) heads[t] = (Uint32)SDL_AtomicGet(&prof_tracks[t].head);
+#endif
+    for (int f = -BENCH_WARMUP; f < frames; f++) {
+        if (s->step) s->step();
+        Uint64 t0 = SDL_GetPerformanceCounter();
+        update();
+        Uint64 t1 = SDL_GetPerformanceCounter();
+        snapshot_publish();
+        Uint64 t2 = SDL_GetPerformanceCounter(), t3 = t2;
+        if (renderer) {
+            snapshot_acquire();
+            render();
+            t3 = SDL_GetPerformanceCounter();
+        }
+        float ms[PROF_PHASE_COUNT] = {0};
+#ifndef HARVESTER_NO_PROFILER
+        bench_collect(heads, ms);
+#endif
+        if (f < 0) continue;
+        ms[PROF_TICK] = (float)((t1 - t0) * to_ms);
+        if (renderer) ms[PROF_FRAME] = (float)((t3 - t2) * to_ms);
+        for (int p = 0; p < PROF_PHASE_COUNT; p++) {
+            samples[p * frames + f] = ms[p];
+            if (ms[p] > 0) seen[p] = true;
         }
     }
     
-    float sun_pulse = 1.0f + 0.12f * sinf(sun.pulse_phase);
-    float sun_r = sun.radius * sun_pulse;
-    SDL_SetRenderDrawColor(renderer, 255, 255, 180, 90);
-    for (int r = (int)sun_r + 55; r > (int)sun_r + 18; r -= 12) {
-        for (int dy = -r; dy <= r; dy += 9) {
-            int hw = (int)sqrtf(r*r - dy*dy);
-            SDL_RenderDrawLine(renderer, (int)sun.base_x - hw, (int)(sun.base_y + dy),
-                                     (int)sun.base_x + hw, (int)(sun.base_y + dy));
+    printf("%s: %d frames, ended with %d clouds, %d creatures, %d/%d particles, %d game overs\n",
+           s->name, frames, world->clouds.count, world->creatures.count, world->particles.count, world->particles.capacity, world->game_overs);
+    printf("  %-14s %8s %8s %8s %8s  (ms)\n", "phase", "p50", "p95", "p99", "max");
+    for (int p = 0; p < PROF_PHASE_COUNT; p++) {
+        if (!seen[p] || bench_result_cnt == BENCH_MAX_RESULTS) continue;
+        float* v = &samples[p * frames];
+        qsort(v, frames, sizeof(float), compare_floats);
+        BenchResult* r = &bench_results[bench_result_cnt++];
+        snprintf(r->scenario, sizeof(r->scenario), "%s", s->name);
+        snprintf(r->phase, sizeof(r->phase), "%s", prof_phases[p].name);
+        r->samples = frames;
+        r->p50 = percentile(v, frames, 0.50);
+        r->p95 = percentile(v, frames, 0.95);
+        r->p99 = percentile(v, frames, 0.99);
+        r->max = v[frames - 1];
+        printf("  %-14s %8.3f %8.3f %8.3f %8.3f\n", r->phase, r->p50, r->p95, r->p99, r->max);
+    }
+}
+
+// One result per line, which is also what bench_load expects
+bool bench_save(const char* path, int frames) {
+    FILE* f = fopen(path, "w");
+    if (!f) return false;
+    fprintf(f, "{\"frames\": %d, \"seed\": %d, \"renderer\": \"%s\", \"results\": [\n",
+            frames, BENCH_SEED, renderer ? render_path_names[render_path] : "none");
+    for (int i = 0; i < bench_result_cnt; i++) {
+        const BenchResult* r = &bench_results[i];
+        fprintf(f, "{\"scenario\": \"%s\", \"phase\": \"%s\", \"samples\": %d, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+                r->scenario, r->phase, r->samples, r->p50, r->p95, r->p99, r->max, i + 1 < bench_result_cnt ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// Reads back a file written by bench_save; returns the number of results,
+// or -1 if it can't be opened
+int bench_load(const char* path, BenchResult* out, int max) {
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    char line[512];
+    int n = 0;
+    while (n < max && fgets(line, sizeof(line), f)) {
+        BenchResult* r = &out[n];
+        if (sscanf(line, " {\"scenario\": \"%31[^\"]\", \"phase\": \"%31[^\"]\", \"samples\": %d, \"p50\": %lf, \"p95\": %lf, \"p99\": %lf, \"max\": %lf",
+                   r->scenario, r->phase, &r->samples, &r->p50, &r->p95, &r->p99, &r->max) == 7) n++;
+    }
+    fclose(f);
+    return n;
+}
+
+bool bench_regressed(double now, double base, double tolerance) {
+    return now > base * (1 + tolerance) && now - base > BENCH_NOISE_MS;
+}
+
+// Flags every phase whose p50 or p95 got slower than the baseline by more
+// than tolerance (a fraction). Returns false if anything regressed.
+bool bench_compare(const char* path, double tolerance) {
+    static BenchResult base[BENCH_MAX_RESULTS];
+    int n = bench_load(path, base, BENCH_MAX_RESULTS);
+    if (n < 0) {
+        fprintf(stderr, "Could not read baseline %s\n", path);
+        return false;
+    }
+    printf("Against baseline %s (tolerance %.0f%%):\n", path, tolerance * 100);
+    int regressions = 0;
+    for (int i = 0; i < bench_result_cnt; i++) {
+        const BenchResult* r = &bench_results[i];
+        const BenchResult* b = NULL;
+        for (int k = 0; k < n && !b; k++) {
+            if (strcmp(base[k].scenario, r->scenario) == 0 && strcmp(base[k].phase, r->phase) == 0) b = &base[k];
         }
+        if (!b) {
+            printf("  %-10s %-14s not in baseline\n", r->scenario, r->phase);
+            continue;
+        }
+        bool regressed = bench_regressed(r->p50, b->p50, tolerance) || bench_regressed(r->p95, b->p95, tolerance);
+        regressions += regressed;
+        printf("  %-10s %-14s p50 %7.3f -> %7.3f (%+6.1f%%)  p95 %7.3f -> %7.3f (%+6.1f%%)%s\n",
+               r->scenario, r->phase, b->p50, r->p50, b->p50 > 0 ? (r->p50 / b->p50 - 1) * 100 : 0.0,
+               b->p95, r->p95, b->p95 > 0 ? (r->p95 / b->p95 - 1) * 100 : 0.0, regressed ? "  REGRESSION" : "");
     }
-    SDL_SetRenderDrawColor(renderer, 255, 240, 140, 255);
-    for (int dy = -sun_r; dy <= sun_r; dy += 5) {
-        int hw = (int)sqrtf(sun_r*sun_r - dy*dy);
-        SDL_RenderDrawLine(renderer, (int)sun.base_x - hw, (int)(sun.base_y + dy),
-                                 (int)sun.base_x + hw, (int)(sun.base_y + dy));
+    printf("%d regressions\n", regressions);
+    return regressions == 0;
+}
+
+// Runs the scenarios (all, or just `only`), writes the results to out_path
+// and compares them with baseline_path if given. Returns false on a
+// regression or an error.
+bool run_bench(const char* only, int frames, const char* out_path, const char* baseline_path, double tolerance) {
+    frames = SDL_max(frames, 1);
+    float* samples = malloc((size_t)frames * PROF_PHASE_COUNT * sizeof(float));
+    if (!samples) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
     }
-    
-    // Draw nebulae
-    for (int i = 0; i < MAX_NEBULAE; i++) {
-        if (nebulas[i].active) {
-            draw_nebula(&nebulas[i]);
+    SDL_AtomicSet(&snapshot_spare, 2);
+    int ran = 0;
+    for (int i = 0; i < (int)SDL_arraysize(bench_scenarios); i++) {
+        if (only && strcmp(only, bench_scenarios[i].name) != 0) continue;
+        bench_scenario(&bench_scenarios[i], frames, samples);
+        ran++;
+    }
+    free(samples);
+    if (!ran) {
+        fprintf(stderr, "No scenario called %s\n", only);
+        return false;
+    }
+    bool ok = true;
+    if (out_path) {
+        if (bench_save(out_path, frames)) printf("Results written to %s\n", out_path);
+        else {
+            fprintf(stderr, "Could not write %s\n", out_path);
+            ok = false;
         }
     }
+    if (baseline_path) ok &= bench_compare(baseline_path, tolerance);
+    return ok;
+}
+
+// Emulates rollback netcode against a peer whose input arrives
+// ROLLBACK_BENCH_DELAY ticks late. Every tick runs on predicted input (the
+// newest confirmed one); when a confirmed input turns out to differ from its
+// prediction, the ticks since are rolled back and resimulated. The end state
+// must match a plain run with the confirmed input. The autopilot plays the
+// peer.
+#define ROLLBACK_BENCH_DELAY 8
+
+Uint8* logged_inputs;
+long logged_input_cnt = 0;
+
+Uint8 logged_autopilot_input() {
+    Uint8 in = autopilot_input();
+    logged_inputs[logged_input_cnt++] = in;
+    return in;
+}
+
+bool rollback_bench(long ticks, Uint64 seed, bool delta) {
+    Uint8* actual = malloc(ticks);
+    Uint8* predicted = malloc(ticks);
+    if (!actual || !predicted || !rollback_init(delta)) {
+        free(actual);
+        free(predicted);
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    logged_inputs = actual;
+    logged_input_cnt = 0;
+    world->input_source = logged_autopilot_input;
+    rng_seed_all(seed);
+    init_game();
+    world->prev_tractor = false;
+    for (long t = 0; t < ticks; t++) update();
+    Uint64 reference = world_hash();
     
-    for (int i = 0; i < NUM_PLANETS; i++) {
-        Planet* p = &planets[i];
-        float px = p->base_x - scrollX * 0.12f;
-        if (px < -350 || px > WINDOW_W + 350) continue;
-        
-        p->spin += 0.0018f;
-        int r = (int)p->radius;
-        for (int dy = -r; dy <= r; dy += 4) {
-            int hw = (int)sqrtf(r*r - dy*dy);
-            float swirl = sinf(dy * 0.035f + p->spin * 5);
-            Uint8 alpha = 140 + (int)(95 * swirl);
-            SDL_SetRenderDrawColor(renderer, (p->color>>16)&255, (p->color>>8)&255, p->color&255, alpha);
-            SDL_RenderDrawLine(renderer, (int)(px - hw), (int)(p->base_y + dy), (int)(px + hw), (int)(p->base_y + dy));
+    rng_seed_all(seed);
+    init_game();
+    world->prev_tractor = false;
+    rollback_save();
+    Uint64 freq = SDL_GetPerformanceFrequency(), resim_total = 0, resim_max = 0;
+    long rollbacks = 0;
+    bool ok = true;
+    for (long t = 0; t < ticks + ROLLBACK_BENCH_DELAY && ok; t++) {
+        long c = t - ROLLBACK_BENCH_DELAY;   // the tick whose input arrives now
+        if (c >= 0 && actual[c] != predicted[c]) {
+            int n = (int)(SDL_min(t, ticks) - c);
+            for (long k = c; k < c + n; k++) predicted[k] = actual[c];
+            Uint64 t0 = SDL_GetPerformanceCounter();
+            ok = rollback_resimulate(n, &predicted[c]);
+            Uint64 dt = SDL_GetPerformanceCounter() - t0;
+            resim_total += dt;
+            resim_max = SDL_max(resim_max, dt);
+            rollbacks++;
+        }
+        if (t < ticks) {
+            predicted[t] = c >= 0 ? actual[c] : 0;
+            rollback_advance(&predicted[t], 1);
         }
     }
+    Uint64 result = world_hash();
+    int depth = rollback_depth();
     
-    for (int i = 0; i < cloud_cnt; i++) if (clouds[i].active) draw_gas_cloud(&clouds[i]);
-    for (int i = 0; i < creature_cnt; i++) if (creatures[i].active) draw_nebula_creature(&creatures[i]);
+    // Save and restore on their own, restoring every tick still held
+    enum { REPS = 1000 };
+    Uint64 t0 = SDL_GetPerformanceCounter();
+    for (int i = 0; i < REPS; i++) rollback_save();
+    double save_us = (double)(SDL_GetPerformanceCounter() - t0) * 1e6 / freq / REPS;
+    t0 = SDL_GetPerformanceCounter();
+    for (int i = 0; i < REPS; i++) rollback_restore(0);
+    double restore_us = (double)(SDL_GetPerformanceCounter() - t0) * 1e6 / freq / REPS;
     
-    for (int i = 0; i < particle_cnt; i++) {
-        Particle* p = &particles[i];
-        int alpha = (int)(255 * (p->life / 60.0f));
-        if (alpha < 25) continue;
-        SDL_SetRenderDrawColor(renderer, (p->color>>16)&255, (p->color>>8)&255, p->color&255, alpha);
-        int px = (int)p->x, py = (int)p->y;
-        SDL_RenderDrawPoint(renderer, px, py);
-        if (alpha > 100) {
-            SDL_RenderDrawPoint(renderer, px+1, py);
-            SDL_RenderDrawPoint(renderer, px, py+1);
+    printf("Rollback: %ld ticks, input %d ticks late, %ld rollbacks (%.1f%% of ticks)\n",
+           ticks, ROLLBACK_BENCH_DELAY, rollbacks, 100.0 * rollbacks / ticks);
+    printf("  resimulation of up to %d ticks: avg %.3f ms, max %.3f ms (frame budget %.1f ms)\n", ROLLBACK_BENCH_DELAY,
+           rollbacks ? (double)resim_total * 1000 / freq / rollbacks : 0.0, (double)resim_max * 1000 / freq, 1000.0 / SIM_HZ);
+    printf("  state %.1f KB, %d ticks held; save %.2f us, restore %.2f us\n",
+           rollback.state_size / 1024.0, depth, save_us, restore_us);
+    if (delta && rollback.deltas) {
+        double avg = (double)rollback.delta_bytes / rollback.deltas;
+        printf("  deltas: %.1f KB on average, %.1fx smaller than a state\n", avg / 1024, rollback.state_size / avg);
+    }
+    ok &= result == reference;
+    printf("  end state %016llx, plain run %016llx: %s\n", (unsigned long long)result,
+           (unsigned long long)reference, result == reference ? "match" : "DIVERGED");
+    arena_destroy(&rollback.mem);
+    free(actual);
+    free(predicted);
+    return ok;
+}
+
+void print_usage(FILE* out, const char* prog) {
+    fprintf(out, "Usage: %s [options]\n"
+        "Rendering:\n"
+        "  --immediate | --software     render path (default: batched)\n"
+        "  --window WxH                 window size\n"
+        "  --render-scale S             internal resolution relative to the world, 0.25 to 4\n"
+        "  --dynamic-resolution         lower the render scale to hold the frame budget\n"
+        "  --frame-budget MS            frame budget of the quality governor\n"
+        "  --no-governor | --lod N      fixed quality level\n"
+        "  --threads N                  render worker threads\n"
+        "  --no-sprite-cache | --no-layer-cache | --no-hud-cache | --no-particle-buckets\n"
+        "  --particle-stats             show the particle budget on screen\n"
+        "Simulation:\n"
+        "  --seed N                     seed of every random stream\n"
+        "  --sim-threads N | --no-sim-thread\n"
+        "  --headless TICKS             run without a window and report\n"
+        "  --expect-hash HEX            fail a headless run whose final state hash differs\n"
+        "  --worlds N                   step N independent worlds as a batch\n"
+        "  --no-cosmetics               skip particles and other effects\n"
+        "  --script FILE | --record FILE | --replay FILE | --replay-window\n"
+        "  --rollback-bench TICKS | --rollback-delta\n"
+        "Capacities (also settable as key = value in --config FILE):\n", prog);
+    for (int i = 0; i < (int)SDL_arraysize(capacity_options); i++) fprintf(out, "  --%s N\n", capacity_options[i].key);
+    fprintf(out, "Benchmarks:\n"
+        "  --bench | --bench-scenario NAME | --bench-frames N | --bench-out FILE\n"
+        "  --bench-baseline FILE | --bench-tolerance PERCENT\n"
+        "  --bench-math | --bench-particles N\n");
+#ifndef HARVESTER_NO_PROFILER
+    fprintf(out, "  --profile PREFIX             write the frame profile to PREFIX.csv and PREFIX.json\n");
+#endif
+}
+
+#ifndef HARVESTER_NO_MAIN
+int main(int argc, char* argv[]) {
+    long headless_ticks = 0;
+    const char* expect_hash = NULL;
+    bool bench = false;
+    const char* bench_only = NULL;
+    const char* bench_out = "bench.json";
+    const char* bench_baseline = NULL;
+    int bench_frames = 600;
+    double bench_tolerance = 0.10;
+    const char* record_path = NULL;
+    bool replay_window = false;
+    long rollback_ticks = 0;
+    int batch_worlds = 0;
+    Uint64 seed = (Uint64)time(NULL);
+    int window_w = WORLD_W, window_h = WORLD_H;
+#ifndef HARVESTER_NO_PROFILER
+    const char* profile_prefix = NULL;
+#endif
+    main_world.input_source = keyboard_input;
+    for (int i = 1; i < argc; i++) {
+        // Every option that matches ends with continue, so a value it took is
+        // never looked at as an option itself
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            print_usage(stdout, argv[0]);
+            return 0;
+        }
+        if (strcmp(argv[i], "--immediate") == 0) { render_path = RENDER_IMMEDIATE; continue; }
+        if (strcmp(argv[i], "--software") == 0) { render_path = RENDER_SOFTWARE; continue; }
+        if (strcmp(argv[i], "--threads") == 0 && has_value) { worker_threads = atoi(argv[++i]); continue; }
+        if (strcmp(argv[i], "--sim-threads") == 0 && has_value) { sim_threads = atoi(argv[++i]); continue; }
+        if (strcmp(argv[i], "--no-sim-thread") == 0) { use_sim_thread = false; continue; }
+        if (strcmp(argv[i], "--no-sprite-cache") == 0) { use_sprite_cache = false; continue; }
+        if (strcmp(argv[i], "--no-layer-cache") == 0) { use_layer_cache = false; continue; }
+        if (strcmp(argv[i], "--no-hud-cache") == 0) { use_hud_cache = false; continue; }
+        if (strcmp(argv[i], "--window") == 0 && has_value) {
+            if (sscanf(argv[++i], "%dx%d", &window_w, &window_h) != 2) {
+                window_w = WORLD_W;
+                window_h = WORLD_H;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "--render-scale") == 0 && has_value) {
+            set_render_scale(atof(argv[++i]));
+            render_scale_max = render_scale;
+            continue;
+        }
+        if (strcmp(argv[i], "--dynamic-resolution") == 0) { dynamic_resolution = true; continue; }
+        if (strcmp(argv[i], "--frame-budget") == 0 && has_value) { governor.budget_ms = atof(argv[++i]); continue; }
+        if (strcmp(argv[i], "--no-governor") == 0) { governor.enabled = false; continue; }
+        if (strcmp(argv[i], "--lod") == 0 && has_value) {
+            int level = atoi(argv[++i]);
+            lod = SDL_max(0, SDL_min(level, LOD_COUNT - 1));
+            governor.enabled = false;
+            continue;
+        }
+        if (strcmp(argv[i], "--no-particle-buckets") == 0) { use_particle_buckets = false; continue; }
+        if (strcmp(argv[i], "--particle-stats") == 0) { show_particle_stats = true; continue; }
+#ifndef HARVESTER_NO_PROFILER
+        if (strcmp(argv[i], "--profile") == 0 && has_value) { profile_prefix = argv[++i]; continue; }
+#endif
+        if (strcmp(argv[i], "--headless") == 0 && has_value) { headless_ticks = atol(argv[++i]); continue; }
+        if (strcmp(argv[i], "--seed") == 0 && has_value) { seed = strtoull(argv[++i], NULL, 10); continue; }
+        if (strcmp(argv[i], "--expect-hash") == 0 && has_value) { expect_hash = argv[++i]; continue; }
+        if (strcmp(argv[i], "--worlds") == 0 && has_value) { batch_worlds = atoi(argv[++i]); continue; }
+        if (strcmp(argv[i], "--no-cosmetics") == 0) { main_world.cosmetics = false; continue; }
+        if (strcmp(argv[i], "--bench-math") == 0) return bench_math() ? 0 : 1;
+        if (strcmp(argv[i], "--bench") == 0) { bench = true; continue; }
+        if (strcmp(argv[i], "--bench-scenario") == 0 && has_value) { bench_only = argv[++i]; continue; }
+        if (strcmp(argv[i], "--bench-frames") == 0 && has_value) { bench_frames = atoi(argv[++i]); continue; }
+        if (strcmp(argv[i], "--bench-out") == 0 && has_value) { bench_out = argv[++i]; continue; }
+        if (strcmp(argv[i], "--bench-baseline") == 0 && has_value) { bench_baseline = argv[++i]; continue; }
+        if (strcmp(argv[i], "--bench-tolerance") == 0 && has_value) { bench_tolerance = atof(argv[++i]) / 100; continue; }
+        if (strcmp(argv[i], "--bench-particles") == 0 && has_value) {
+            bench_particles(atoi(argv[++i]));
+            return 0;
+        }
+        if (strcmp(argv[i], "--config") == 0 && has_value) {
+            if (!load_config(argv[++i])) {
+                fprintf(stderr, "Could not load config %s\n", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "--script") == 0 && has_value) {
+            if (!load_input_script(argv[++i])) {
+                fprintf(stderr, "Could not load input script %s\n", argv[i]);
+                return 1;
+            }
+            world->input_source = script_input;
+            continue;
+        }
+        if (strcmp(argv[i], "--record") == 0 && has_value) { record_path = argv[++i]; continue; }
+        if (strcmp(argv[i], "--replay") == 0 && has_value) {
+            if (!replay_load(argv[++i])) {
+                fprintf(stderr, "Could not load recording %s\n", argv[i]);
+                return 1;
+            }
+            world->input_source = replay_input;
+            continue;
+        }
+        if (strcmp(argv[i], "--replay-window") == 0) { replay_window = true; continue; }
+        if (strcmp(argv[i], "--rollback-bench") == 0 && has_value) { rollback_ticks = atol(argv[++i]); continue; }
+        if (strcmp(argv[i], "--rollback-delta") == 0) { use_rollback_delta = true; continue; }
+        if (strncmp(argv[i], "--", 2) == 0 && find_capacity(argv[i] + 2)) {
+            if (!has_value || !set_capacity(argv[i] + 2, argv[i + 1])) {
+                fprintf(stderr, "%s needs a whole number\n", argv[i]);
+                return 1;
+            }
+            i++;
+            continue;
         }
+        fprintf(stderr, "Unknown option or missing value: %s\n", argv[i]);
+        print_usage(stderr, argv[0]);
+        return 1;
+    }
+    bool replaying = world->input_source == replay_input;
+    if (replaying) {
+        // A replay only matches if it starts exactly where the recording did
+        caps = replay.caps;
+        seed = replay.seed;
+        if (!replay_window && headless_ticks == 0) headless_ticks = SDL_max(replay.total_ticks, 1);
     }
     
-    draw_ship();
+    if (!world_init()) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    pool_init(&sim_pool, sim_threads);
+#ifndef HARVESTER_NO_PROFILER
+    prof_epoch = SDL_GetPerformanceCounter();
+#endif
     
-    // FIXED SCORE DISPLAY: digits grow from the RIGHT (least significant first)
-    int display_score = ship.score % 1000000;
-    char score_buf[7];
-    sprintf(score_buf, "%06d", display_score);
-    
-    int digit_w = 32;
-    int digit_spacing = digit_w + 10;
-    int start_x = WINDOW_W - 60;                        // right edge anchor
-    int start_y = 10;
-    
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-    for (int i = 0; i < 6; i++) {
-        int digit = score_buf[5 - i] - '0';             // read from right to left
-        int bx = start_x - i * digit_spacing;           // place digits from right
-        draw_7segment_digit(bx, start_y, digit);
-    }
-    
-    // Lives (unchanged)
-    for (int i = 0; i < ship.lives; i++) {
-        int lx = 40 + i * 45;
-        SDL_SetRenderDrawColor(renderer, 180, 255, 180, 255);
-        thick_line(lx, 20, lx + 30, 20, 5);
-        thick_line(lx + 8, 30, lx + 22, 30, 5);
-    }
-    
-    // Fuel bar (unchanged)
-    int fuel_fill = (int)((ship.fuel / 1000.0f) * 220);
-    SDL_SetRenderDrawColor(renderer, 40, 60, 80, 220);
-    SDL_RenderFillRect(renderer, &(SDL_Rect){30, 70, 240, 18});
-    SDL_SetRenderDrawColor(renderer, 80, 200, 255, 255);
-    SDL_RenderFillRect(renderer, &(SDL_Rect){33, 73, fuel_fill, 12});
-    
-    // Heat bar (unchanged)
-    int heat_fill = (int)((ship.heat / OVERHEAT_MAX) * 220);
-    SDL_SetRenderDrawColor(renderer, 100, 40, 40, 220);
-    SDL_RenderFillRect(renderer, &(SDL_Rect){30, 95, 240, 14});
-    if (is_critical_overheat()) {
-        SDL_SetRenderDrawColor(renderer, 255, 60, 40, 255);
-    } else if (is_overheat_warning()) {
-        SDL_SetRenderDrawColor(renderer, 255, 140, 40, 255);
-    } else {
-        SDL_SetRenderDrawColor(renderer, 255, 100, 80, 255);
+    if (rollback_ticks > 0) {
+        bool ok = rollback_bench(rollback_ticks, seed, use_rollback_delta);
+        pool_shutdown(&sim_pool);
+        return ok ? 0 : 1;
     }
-    SDL_RenderFillRect(renderer, &(SDL_Rect){33, 98, heat_fill, 8});
     
-    // Combo meter (unchanged)
-    if (ship.combo > 0) {
-        int combo_w = ship.combo * 10;
-        int max_w = 200;
-        if (combo_w > max_w) combo_w = max_w;
-        
-        float pulse = sinf(frame * 0.35f) * 0.5f + 0.5f;
-        Uint8 r = 255;
-        Uint8 g = 220 + (Uint8)(35 * pulse);
-        Uint8 b = 100 + (Uint8)(100 * pulse);
-        Uint8 a = (Uint8)(200 + 55 * pulse);
-        
-        SDL_SetRenderDrawColor(renderer, r, g, b, a);
-        SDL_RenderFillRect(renderer, &(SDL_Rect){WINDOW_W/2 - combo_w/2, 20, combo_w, 24});
-        
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, (Uint8)(100 + 155 * pulse));
-        SDL_RenderDrawRect(renderer, &(SDL_Rect){WINDOW_W/2 - combo_w/2 - 3, 17, combo_w + 6, 30});
-        
-        if (ship.combo_boost_active) {
-            SDL_SetRenderDrawColor(renderer, 255, 220, 50, 255);
-            for (int off = 0; off < 8; off += 2) {
-                SDL_RenderDrawRect(renderer, &(SDL_Rect){WINDOW_W/2 - combo_w/2 - 8 - off, 12 - off, combo_w + 16 + off*2, 40 + off*2});
-            }
-        }
+    if (batch_worlds > 0) {
+        double wtps = run_worlds(batch_worlds, headless_ticks > 0 ? headless_ticks : 600, seed, main_world.cosmetics);
+        pool_shutdown(&sim_pool);
+        return wtps > 0 ? 0 : 1;
     }
     
-    // Wave indicator (numbers only, bottom-right)
-    SDL_SetRenderDrawColor(renderer, 200, 200, 200, 255);
-    int tx = WINDOW_W - 100;
-    int ty = WINDOW_H - 50;
-    int wave_digit_x = tx;
-    draw_7segment_digit(wave_digit_x + 35, ty - 8, wave % 10);
-    if (wave >= 10) draw_7segment_digit(wave_digit_x, ty - 8, (wave / 10) % 10);
+    if (record_path && !recorder_open(record_path, seed)) {
+        fprintf(stderr, "Could not create %s\n", record_path);
+        return 1;
+    }
     
-    // Flash yellow when advancing
-    if (current_wave_display_timer > 0) {
-        current_wave_display_timer--;
-        Uint8 flash_alpha = (Uint8)(180 + 75 * sinf(frame * 0.5f));
-        SDL_SetRenderDrawColor(renderer, 255, 255, 100, flash_alpha);
-        draw_7segment_digit(wave_digit_x + 35, ty - 8, wave % 10);
-        if (wave >= 10) draw_7segment_digit(wave_digit_x, ty - 8, (wave / 10) % 10);
+    if (headless_ticks > 0) {
+        run_headless(headless_ticks, seed);
+        recorder_close();
+        if (replaying && !SDL_AtomicGet(&replay.done)) replay_report();
+#ifndef HARVESTER_NO_PROFILER
+        if (profile_prefix) prof_export(profile_prefix);
+#endif
+        pool_shutdown(&sim_pool);
+        // A known hash for a seed pins the simulation down, so a build whose
+        // float math differs fails here rather than in someone's replay
+        bool hash_ok = !expect_hash || world_hash() == strtoull(expect_hash, NULL, 16);
+        if (!hash_ok) fprintf(stderr, "State hash %016llx, expected %s\n", (unsigned long long)world_hash(), expect_hash);
+        return (replaying && replay.diverged) || !hash_ok ? 1 : 0;
+    }
+    
+    if (bench) {
+        // A hidden window without vsync, so frames are timed rather than paced,
+        // at a fixed quality level so runs stay comparable
+        governor.enabled = false;
+        if (SDL_Init(SDL_INIT_VIDEO) == 0) {
+            window = SDL_CreateWindow("Nebula Harvester", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WORLD_W, WORLD_H, SDL_WINDOW_HIDDEN);
+        }
+        if (window) renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+        if (renderer) {
+            SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+            batch_init();
+            pool_init(&thread_pool, worker_threads);
+            if (render_path == RENDER_SOFTWARE) set_render_path(RENDER_SOFTWARE);
+        } else {
+            fprintf(stderr, "No renderer (%s), benchmarking the simulation only\n", SDL_GetError());
+        }
+        bool ok = run_bench(bench_only, bench_frames, bench_out, bench_baseline, bench_tolerance);
+        sprite_cache_clear();
+        layer_cache_clear();
+        hud_cache_clear();
+        if (frame_target) SDL_DestroyTexture(frame_target);
+        if (renderer) pool_shutdown(&thread_pool);
+        pool_shutdown(&sim_pool);
+        if (renderer) SDL_DestroyRenderer(renderer);
+        if (window) SDL_DestroyWindow(window);
+        SDL_Quit();
+        return ok ? 0 : 1;
     }
     
-    SDL_RenderPresent(renderer);
-}
-
-int main(int argc, char* argv[]) {
     SDL_Init(SDL_INIT_VIDEO);
-    window = SDL_CreateWindow("Nebula Harvester", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_W, WINDOW_H, 0);
+    window = SDL_CreateWindow("Nebula Harvester", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                              SDL_max(window_w, 160), SDL_max(window_h, 90), SDL_WINDOW_RESIZABLE);
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    batch_init();
+    pool_init(&thread_pool, worker_threads);
+    if (render_path == RENDER_SOFTWARE) set_render_path(RENDER_SOFTWARE);
     
+    SDL_RendererInfo info;
+    bool vsync = SDL_GetRendererInfo(renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC);
+    
+    rng_seed_all(seed);
     init_game();
+    sim_start();
+    
+    Uint64 tick_len = SDL_GetPerformanceFrequency() / SIM_HZ;
+    Uint64 ms = SDL_GetPerformanceFrequency() / 1000;
+    Uint64 accumulator = tick_len;
+    Uint64 last_time = SDL_GetPerformanceCounter();
     
     bool running = true;
     while (running) {
         SDL_Event ev;
         while (SDL_PollEvent(&ev)) {
             if (ev.type == SDL_QUIT) running = false;
+            if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_F1) {
+                set_render_path((render_path + 1) % RENDER_PATH_COUNT);
+            }
+            if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_F2) {
+                use_sprite_cache = !use_sprite_cache;
+                sprite_cache_report();
+            }
+            if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_F3) loop_stats_report();
+            if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_F4) {
+                use_particle_buckets = !use_particle_buckets;
+                printf("Particle renderer: %s\n", use_particle_buckets ? "bucketed" : "per particle");
+            }
+            if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_F5) show_particle_stats = !show_particle_stats;
+            if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_F6) compare_render_paths();
+            if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_F7) {
+                use_layer_cache = !use_layer_cache;
+                layer_cache_report();
+            }
+            if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_F10) {
+                use_hud_cache = !use_hud_cache;
+                hud_cache_report();
+            }
+#ifndef HARVESTER_NO_PROFILER
+            if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_F8) show_profiler = !show_profiler;
+            if (ev.type == SDL_KEYDOWN && ev.key.keysym.sym == SDLK_F9) prof_export("profile");
+#endif
         }
+        keyboard_sample();
         
-        update();
+        Uint64 now = SDL_GetPerformanceCounter();
+        accumulator += now - last_time;
+        last_time = now;
+        
+        // A replay runs as fast as the simulation can go until it ends
+        bool fast = replaying && !SDL_AtomicGet(&replay.done);
+        int ticks = 0;
+        if (fast) {
+            ticks = MAX_TICKS_PER_FRAME;
+            accumulator = 0;
+        }
+        while (accumulator >= tick_len && ticks < MAX_TICKS_PER_FRAME) {
+            accumulator -= tick_len;
+            ticks++;
+        }
+        if (accumulator >= tick_len) {
+            // Too far behind to catch up; drop the backlog instead of spiralling
+            loop_stats.missed_deadlines++;
+            loop_stats.dropped_ticks += accumulator / tick_len;
+            accumulator %= tick_len;
+        }
+        int accepted = sim_queue_ticks(ticks);
+        if (accepted < ticks && fast) ticks = accepted;
+        if (accepted < ticks) {
+            // The simulation thread still has a full backlog
+            loop_stats.missed_deadlines++;
+            loop_stats.dropped_ticks += ticks - accepted;
+            ticks = accepted;
+        }
+        loop_stats.frames++;
+        loop_stats.ticks += ticks;
+        loop_stats.ticks_per_frame[ticks]++;
+        
+        render_alpha = (float)accumulator / tick_len;
+        snapshot_acquire();
         render();
-        SDL_Delay(16);
+        
+        if (!vsync && !fast) {
+            // Only sleep when the next tick is comfortably far away
+            Uint64 elapsed = SDL_GetPerformanceCounter() - last_time;
+            Uint64 until_tick = tick_len - accumulator;
+            if (until_tick > elapsed + 2 * ms) {
+                SDL_Delay((Uint32)((until_tick - elapsed) / ms) - 1);
+                loop_stats.sleeps++;
+            }
+        }
     }
     
+    sim_stop();
+    recorder_close();
+    if (replaying && !SDL_AtomicGet(&replay.done)) replay_report();
+#ifndef HARVESTER_NO_PROFILER
+    if (profile_prefix) prof_export(profile_prefix);
+#endif
+    loop_stats_report();
+    sprite_cache_report();
+    layer_cache_report();
+    hud_cache_report();
+    governor_report();
+    particle_budget_report();
+    sprite_cache_clear();
+    layer_cache_clear();
+    hud_cache_clear();
+    if (frame_target) SDL_DestroyTexture(frame_target);
+    pool_shutdown(&thread_pool);
+    pool_shutdown(&sim_pool);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
     return 0;
-}
\ No newline at end of file
+}
+#endif